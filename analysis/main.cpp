@@ -0,0 +1,53 @@
+#include <TROOT.h>
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TAnalysisRunner.hpp"
+
+// eve-analysis <module> [-t nThreads] [-d directory] [file ...]
+// Runs the analysis module (plugin) over the given event files, or over the
+// events_t* files of the directory (./ by default).
+int main(int argc, char *argv[])
+{
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0]
+              << " <module> [-t nThreads] [-d directory] [file ...]"
+              << std::endl;
+    return 1;
+  }
+  std::string moduleName = argv[1];
+  uint32_t nThreads = std::thread::hardware_concurrency();
+  std::vector<std::string> directories;
+  std::vector<std::string> fileList;
+  for (auto i = 2; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "-t" && i + 1 < argc) {
+      nThreads = std::stoul(argv[++i]);
+    } else if (arg == "-d" && i + 1 < argc) {
+      directories.push_back(argv[++i]);
+    } else {
+      fileList.push_back(arg);
+    }
+  }
+  if (directories.empty() && fileList.empty()) directories.push_back("./");
+
+  auto module = TAnalysisRunner::LoadModule(moduleName);
+  if (!module) {
+    return 1;
+  }
+
+  gROOT->SetBatch(kTRUE);
+  TAnalysisRunner runner(nThreads);
+  for (const auto &directory : directories) runner.AddDirectory(directory);
+  for (const auto &fileName : fileList) runner.AddFile(fileName);
+  if (runner.GetNFiles() == 0) {
+    std::cerr << "No event file found." << std::endl;
+    return 1;
+  }
+  runner.Run(*module);
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+#include <TFile.h>
+#include <TH1.h>
+#include <TH2.h>
+
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "TAnalysisModule.hpp"
+#include "TCalibrationTable.hpp"
+#include "TChSettings.hpp"
+#include "TCompactHist2D.hpp"
+#include "TLocalHist.hpp"
+
+// Port of macro/reader.cpp: time differences, multiplicities, ADC and
+// calibrated energy of the fission events, written to reader.root
+class TReaderModule : public TAnalysisModule
+{
+ public:
+  TReaderModule() {};
+  ~TReaderModule() {};
+
+  static constexpr uint32_t nModules = 9;
+  static constexpr uint32_t nChannels = 16;
+  static constexpr uint32_t nBins = 32000;
+
+  void Init(uint32_t nWorkers) override
+  {
+    const auto chSettingsVec = TChSettings::GetChSettings("./chSettings.json");
+    ReadSiTimeFunction("Si_time_function.txt");
+
+    for (uint32_t i = 0; i < nChannels; i++) {
+      histTime[i] = new TLocalHist(
+          new TH2D(Form("histTime_%d", i),
+                   Form("Time difference ID%02d and other detectors", i),
+                   20000, -1000, 1000, 151, -0.5, 150.5),
+          nWorkers);
+      histTime[i]->Get()->SetXTitle("[ns]");
+      histTime[i]->Get()->SetYTitle("Detector ID");
+    }
+    histTime[nChannels] = new TLocalHist(
+        new TH2D("histTime", "Time difference between detectors", 20000,
+                 -1000, 1000, 151, -0.5, 150.5),
+        nWorkers);
+
+    histSiMultiplicty = new TLocalHist(
+        new TH1D("histSiMultiplicity", "Si Multiplicity", 33, -0.5, 32.5),
+        nWorkers);
+    histSiMultiplicty->Get()->SetXTitle("Multiplicity");
+    histGammaMultiplicity = new TLocalHist(
+        new TH1D("histGammaMultiplicity", "Gamma Multiplicity", 48, -0.5,
+                 47.5),
+        nWorkers);
+    histGammaMultiplicity->Get()->SetXTitle("Multiplicity");
+    histNeutronMultiplicity = new TLocalHist(
+        new TH1D("histNeutronMultiplicity", "Neutron Multiplicity", 48, -0.5,
+                 47.5),
+        nWorkers);
+    histNeutronMultiplicity->Get()->SetXTitle("Multiplicity");
+
+    for (uint32_t i = 0; i < nModules; i++) {
+      for (uint32_t j = 0; j < nChannels; j++) {
+        histADC[i][j] =
+            new TLocalHist(new TH1D(Form("histADC_%d_%d", i, j),
+                                    Form("Energy Module%02d Channel%02d", i, j),
+                                    nBins, 0.5, nBins + 0.5),
+                           nWorkers);
+        histADC[i][j]->Get()->SetXTitle("ADC channel");
+
+        // Bin edges half way between the energies of adjacent ADC channels
+        const auto &chSetting = chSettingsVec.at(i).at(j);
+        std::vector<double_t> binTable(nBins + 1);
+        for (uint32_t k = 0; k < nBins + 1; k++) {
+          auto nextEdge = (chSetting.GetCalibratedEnergy(k) +
+                           chSetting.GetCalibratedEnergy(k + 1)) /
+                          2.;
+          if (k != 0 && nextEdge < binTable[k - 1]) {
+            nextEdge = binTable[k - 1] + 0.1;
+          }
+          binTable[k] = nextEdge;
+        }
+        histEnergy[i][j] =
+            new TLocalHist(new TH1D(Form("histEnergy_%d_%d", i, j),
+                                    Form("Energy Module%02d Channel%02d", i, j),
+                                    nBins, binTable.data()),
+                           nWorkers);
+        histEnergy[i][j]->Get()->SetXTitle("Energy [keV]");
+        energyTable[i][j] = new TCalibrationTable(
+            chSetting, histEnergy[i][j]->Get()->GetXaxis());
+
+        histADCvsTime[i][j] = new TCompactHist2D(
+            Form("histADCvsTime_%d_%d", i, j),
+            Form("Energy vs Time Module%02d Channel%02d", i, j), 2000, -1000,
+            1000, nBins / 10, 0.5, nBins + 0.5, nWorkers);
+        histADCvsTime[i][j]->SetXTitle("Time [ns]");
+        histADCvsTime[i][j]->SetYTitle("ADC channel");
+        histPSDvsTime[i][j] = new TCompactHist2D(
+            Form("histPSDvsTime_%d_%d", i, j),
+            Form("PSD vs Time Module%02d Channel%02d", i, j), 2000, -1000,
+            1000, 1000, 0, 1, nWorkers);
+        histPSDvsTime[i][j]->SetXTitle("Time [ns]");
+        histPSDvsTime[i][j]->SetYTitle("PSD");
+      }
+    }
+  }
+
+  void Process(TEventReader &event, uint32_t worker) override
+  {
+    if (!event.IsFissionEvent) return;
+    const auto &Module = event.Module;
+    const auto &Channel = event.Channel;
+    const auto &Timestamp = event.Timestamp;
+    const auto &Energy = event.Energy;
+    const auto &EnergyShort = event.EnergyShort;
+    const auto nHits = Module.size();
+
+    uint16_t SiEnergy = 0;
+    uint16_t SiCh = 0;
+    for (size_t j = 0; j < nHits; j++) {
+      if (Module[j] == 0 && Timestamp[j] == 0) {
+        SiCh = Channel[j];
+        SiEnergy = Energy[j];
+        break;
+      }
+    }
+    double_t SiTime = 0;
+    if (SiCh < fSiTimeFunction.size()) {
+      const auto &p = fSiTimeFunction[SiCh];
+      SiTime = p[0] + p[1] * SiEnergy + p[2] * SiEnergy * SiEnergy +
+               p[3] * SiEnergy * SiEnergy * SiEnergy;
+    }
+
+    histSiMultiplicty->Fill(worker, event.SiMultiplicity);
+    histGammaMultiplicity->Fill(worker, event.GammaMultiplicity);
+    histNeutronMultiplicity->Fill(worker, event.NeutronMultiplicity);
+
+    const auto triggerCh = event.TriggerID % 16;
+    for (size_t j = 0; j < nHits; j++) {
+      const auto module = Module[j];
+      const auto channel = Channel[j];
+      const auto timestamp = Timestamp[j] + SiTime;
+      const auto energy = Energy[j];
+      const auto psd = double(energy - EnergyShort[j]) / double(energy);
+
+      const auto hitID = module * 16 + channel;
+      histTime[triggerCh]->Fill(worker, timestamp, hitID);
+      histTime[nChannels]->Fill(worker, timestamp, hitID);  // Sum of all
+
+      histADC[module][channel]->Fill(worker, energy);
+      histEnergy[module][channel]->FillBin(
+          worker, energyTable[module][channel]->GetBin(energy),
+          energyTable[module][channel]->GetEnergy(energy));
+      histADCvsTime[module][channel]->Fill(worker, timestamp, energy);
+      histPSDvsTime[module][channel]->Fill(worker, timestamp, psd);
+    }
+  }
+
+  void Finish() override
+  {
+    TFile file("reader.root", "RECREATE");
+    for (auto hist : histTime) {
+      hist->Merge();
+      hist->Get()->Write();
+    }
+    for (auto hist :
+         {histSiMultiplicty, histGammaMultiplicity, histNeutronMultiplicity}) {
+      hist->Merge();
+      hist->Get()->Write();
+    }
+    for (uint32_t i = 0; i < nModules; i++) {
+      for (uint32_t j = 0; j < nChannels; j++) {
+        histADC[i][j]->Merge();
+        histADC[i][j]->Get()->Write();
+        histEnergy[i][j]->Merge();
+        histEnergy[i][j]->Get()->Write();
+        histADCvsTime[i][j]->Merge();
+        histADCvsTime[i][j]->Write();
+        histPSDvsTime[i][j]->Merge();
+        histPSDvsTime[i][j]->Write();
+      }
+    }
+    file.Close();
+    std::cout << "Histograms written to reader.root" << std::endl;
+  }
+
+ private:
+  // One line per Si channel: ch p0 p1 [p2 p3], missing terms are 0
+  void ReadSiTimeFunction(const std::string &fileName)
+  {
+    std::ifstream ifs(fileName);
+    if (!ifs) {
+      std::cerr << "File not found: " << fileName << std::endl;
+      return;
+    }
+    std::string line;
+    while (std::getline(ifs, line)) {
+      std::istringstream iss(line);
+      int32_t ch;
+      std::array<double_t, 4> p = {0., 0., 0., 0.};
+      iss >> ch >> p[0] >> p[1] >> p[2] >> p[3];
+      fSiTimeFunction.push_back(p);
+    }
+  }
+
+  std::vector<std::array<double_t, 4>> fSiTimeFunction;
+
+  TLocalHist<TH2D> *histTime[nChannels + 1];
+  TLocalHist<TH1D> *histSiMultiplicty;
+  TLocalHist<TH1D> *histGammaMultiplicity;
+  TLocalHist<TH1D> *histNeutronMultiplicity;
+  TLocalHist<TH1D> *histADC[nModules][nChannels];
+  TLocalHist<TH1D> *histEnergy[nModules][nChannels];
+  TCalibrationTable *energyTable[nModules][nChannels];
+  TCompactHist2D *histADCvsTime[nModules][nChannels];
+  TCompactHist2D *histPSDvsTime[nModules][nChannels];
+};
+
+EVE_ANALYSIS_MODULE(TReaderModule)
@@ -0,0 +1,162 @@
+#include <TCanvas.h>
+#include <TF1.h>
+#include <TH1.h>
+#include <TH2.h>
+
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <vector>
+
+#include "TAnalysisModule.hpp"
+#include "TChSettings.hpp"
+#include "TLocalHist.hpp"
+
+// Port of macro/time_alignment.cpp: fits the time of flight peak of every
+// channel and writes the time offsets into chSettings.json
+class TTimeAlignmentModule : public TAnalysisModule
+{
+ public:
+  TTimeAlignmentModule() {};
+  ~TTimeAlignmentModule() {};
+
+  static constexpr uint32_t nModules = 9;
+  static constexpr uint32_t nChannels = 16;
+
+  std::vector<std::string> GetFields() const override
+  {
+    return {"Module", "Channel", "Timestamp", "Energy"};
+  }
+
+  void Init(uint32_t nWorkers) override
+  {
+    histTime = new TLocalHist(
+        new TH2D("histTime", "Time difference between detectors", 20000,
+                 -1000, 1000, 151, -0.5, 150.5),
+        nWorkers);
+    histTriggerADC = new TLocalHist(
+        new TH1D("histTriggerADC", "Trigger ADC", 32000, 0.5, 32000.5),
+        nWorkers);
+  }
+
+  void Process(TEventReader &event, uint32_t worker) override
+  {
+    const auto &Module = event.Module;
+    const auto &Channel = event.Channel;
+    const auto &Timestamp = event.Timestamp;
+    const auto &ADC = event.Energy;
+    const auto nHits = Module.size();
+
+    bool isCo = false;
+    for (size_t i = 0; i < nHits; i++) {
+      if (Timestamp[i] == 0) {
+        if (1225 < ADC[i] && ADC[i] < 1520) {  // For 103
+          // if (1200 < ADC[i] && ADC[i] < 1485) {  // For 115
+          isCo = true;
+          break;
+        }
+      }
+    }
+
+    for (size_t j = 0; j < nHits; j++) {
+      const auto timestamp = Timestamp[j];
+      if (timestamp == 0) {
+        histTriggerADC->Fill(worker, ADC[j]);
+      } else {
+        const auto module = Module[j];
+        const auto hitID = module * 16 + Channel[j];
+        if (isCo || module == 0 || module == 1)
+          histTime->Fill(worker, timestamp, hitID);
+      }
+    }
+  }
+
+  void Finish() override
+  {
+    histTime->Merge();
+    histTriggerADC->Merge();
+
+    auto settingsFileName = "./chSettings.json";
+    auto chSettingsVec = TChSettings::GetChSettings(settingsFileName);
+
+    constexpr double_t lightSpeed = 29.9792458;  // cm/ns
+    std::vector<std::vector<TH1D *>> histTof(nModules,
+                                             std::vector<TH1D *>(nChannels));
+    for (uint32_t i = 0; i < nModules; i++) {
+      for (uint32_t j = 0; j < nChannels; j++) {
+        auto hist = histTime->Get()->ProjectionX(
+            Form("histTof_%d_%d", i, j), i * 16 + j + 1, i * 16 + j + 1);
+        hist->SetTitle(Form("Time of flight for Module %d, Channel %d", i, j));
+        hist->GetXaxis()->SetTitle("Time of flight (ns)");
+        // Si: wide peak
+        FitHist(hist, i < 2 ? 20 : 2);
+        histTof[i][j] = hist;
+      }
+    }
+
+    auto canvas = new TCanvas("canvas", "canvas", 800, 600);
+    canvas->Divide(4, 4);
+    for (uint32_t i = 0; i < nModules; i++) {
+      for (uint32_t j = 0; j < nChannels; j++) {
+        canvas->cd(j + 1);
+        histTof[i][j]->Draw();
+      }
+      canvas->SaveAs(Form("histTof_%d.pdf", i), "pdf");
+    }
+    delete canvas;
+
+    for (uint32_t i = 0; i < nModules; i++) {
+      for (uint32_t j = 0; j < nChannels; j++) {
+        auto fitFunc = histTof[i][j]->GetFunction("f");
+        if (fitFunc) {
+          auto mean = fitFunc->GetParameter(1);
+          if (i < 2) mean = histTof[i][j]->GetMean();
+          if (i == 2 && j == 0) mean = 0;  // Event trigger detector
+          const auto tof = chSettingsVec.at(i).at(j).distance / lightSpeed;
+          chSettingsVec.at(i).at(j).timeOffset = tof - mean;
+          std::cout << "Module " << i << ", Channel " << j
+                    << ", time offset: "
+                    << chSettingsVec.at(i).at(j).timeOffset << std::endl;
+        }
+      }
+    }
+
+    std::ifstream ifs(settingsFileName);
+    nlohmann::json jsonFile;
+    ifs >> jsonFile;
+    ifs.close();
+    for (uint32_t i = 0; i < nModules; i++) {
+      for (uint32_t j = 0; j < nChannels; j++) {
+        jsonFile.at(i).at(j).at("TimeOffset") =
+            chSettingsVec.at(i).at(j).timeOffset;
+        jsonFile.at(i).at(j).at("IsEventTrigger") = (i == 0);
+      }
+    }
+    std::ofstream ofs(settingsFileName);
+    ofs << jsonFile.dump(4);
+    ofs.close();
+  }
+
+ private:
+  // Gaussian around the highest bin, twice
+  static void FitHist(TH1D *hist, double_t sigma)
+  {
+    if (hist->GetEntries() == 0) {
+      return;
+    }
+    auto mean = hist->GetBinCenter(hist->GetMaximumBin());
+    auto f = new TF1("f", "gaus", mean - 1 * sigma, mean + 1 * sigma);
+    f->SetParameters(hist->GetMaximum(), mean, sigma);
+    hist->Fit(f, "QR", "", mean - 1 * sigma, mean + 1 * sigma);
+
+    f->SetRange(mean - 1 * sigma, mean + 1 * sigma);
+    hist->Fit(f, "QR", "", mean - 1 * sigma, mean + 1 * sigma);
+
+    hist->GetXaxis()->SetRangeUser(mean - 5 * sigma, mean + 5 * sigma);
+  }
+
+  TLocalHist<TH2D> *histTime;
+  TLocalHist<TH1D> *histTriggerADC;
+};
+
+EVE_ANALYSIS_MODULE(TTimeAlignmentModule)
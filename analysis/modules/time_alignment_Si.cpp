@@ -0,0 +1,138 @@
+#include <TCanvas.h>
+#include <TF1.h>
+#include <TGraphErrors.h>
+#include <TH1.h>
+#include <TH2.h>
+
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "TAnalysisModule.hpp"
+#include "TLocalHist.hpp"
+
+// Port of macro/time_alignment_Si.cpp: time of the Si hits against their
+// ADC, fitted per channel with a line written to Si_time_function.txt
+class TTimeAlignmentSiModule : public TAnalysisModule
+{
+ public:
+  TTimeAlignmentSiModule() {};
+  ~TTimeAlignmentSiModule() {};
+
+  static constexpr uint32_t nModules = 1;
+  static constexpr uint32_t nChannels = 16;
+
+  std::vector<std::string> GetFields() const override
+  {
+    return {"IsFissionEvent", "Module", "Channel", "Timestamp", "Energy"};
+  }
+
+  void Init(uint32_t nWorkers) override
+  {
+    for (uint32_t i = 0; i < nModules; i++) {
+      for (uint32_t j = 0; j < nChannels; j++) {
+        auto hist = new TH2D(Form("histTimeADC_%d_%d", i, j),
+                             Form("Module %d, Channel %d", i, j), 250, -1000,
+                             1000, 500, 2000.5, 12000.5);
+        hist->GetXaxis()->SetTitle("Time (ns)");
+        hist->GetYaxis()->SetTitle("ADC");
+        histTimeADC[i][j] = new TLocalHist(hist, nWorkers);
+      }
+    }
+  }
+
+  void Process(TEventReader &event, uint32_t worker) override
+  {
+    if (!event.IsFissionEvent) return;
+    const auto nHits = event.Module.size();
+    for (size_t j = 0; j < nHits; j++) {
+      const auto timestamp = event.Timestamp[j];
+      const auto module = event.Module[j];
+      const auto channel = event.Channel[j];
+      if (module < nModules && channel < nChannels && timestamp != 0) {
+        histTimeADC[module][channel]->Fill(worker, timestamp,
+                                           event.Energy[j]);
+      }
+    }
+  }
+
+  void Finish() override
+  {
+    for (uint32_t i = 0; i < nModules; i++) {
+      for (uint32_t j = 0; j < nChannels; j++) histTimeADC[i][j]->Merge();
+    }
+
+    std::ifstream ifs("./chSettings.json");
+    nlohmann::json jsonFile;
+    ifs >> jsonFile;
+    std::vector<TGraphErrors *> graphVec;
+    for (uint32_t j = 0; j < nChannels; j++) {
+      std::vector<TH1D *> histTimeVec;
+      auto histTimeADC0 = histTimeADC[0][j]->Get();
+      const auto nBins = histTimeADC0->GetNbinsY();
+      const auto maxBinContent = histTimeADC0->ProjectionX()->GetMaximum();
+      auto timeOffset = jsonFile.at(0).at(j).at("TimeOffset").get<double>();
+      for (auto i = 1; i <= nBins; i++) {
+        auto hist = histTimeADC0->ProjectionX(Form("histTime_%d", i), i, i);
+        if (hist->GetEntries() > 0.01 * maxBinContent) {
+          auto binCenter = histTimeADC0->GetYaxis()->GetBinCenter(i);
+          hist->SetTitle(Form("%.0f", binCenter));
+          histTimeVec.push_back(hist);
+        }
+      }
+      auto graph = GetTimeGraph(histTimeVec, timeOffset);
+      auto f2 = new TF1(Form("f2_%d", j), "pol1", 0, 30000);
+      graph->Fit(f2, "QR");
+      graphVec.push_back(graph);
+    }
+
+    auto canvas = new TCanvas("canvas", "canvas", 800, 600);
+    canvas->Divide(4, 4);
+    for (uint32_t i = 0; i < graphVec.size(); i++) {
+      canvas->cd(i + 1);
+      graphVec.at(i)->Draw("AP");
+    }
+    canvas->SaveAs("Si_time_function.pdf", "pdf");
+    delete canvas;
+
+    std::string outName = "Si_time_function.txt";
+    std::ofstream outFile(outName);
+    for (uint32_t i = 0; i < graphVec.size(); i++) {
+      auto f2 = graphVec.at(i)->GetFunction(Form("f2_%d", i));
+      outFile << i << " " << f2->GetParameter(0) << " "
+              << f2->GetParameter(1) << std::endl;
+    }
+    outFile.close();
+    std::cout << "Si time functions written to " << outName << std::endl;
+  }
+
+ private:
+  // Peak time of each ADC slice (the title of the histogram)
+  static TGraphErrors *GetTimeGraph(const std::vector<TH1D *> &histVec,
+                                    Double_t timeOffset)
+  {
+    auto nData = histVec.size();
+    auto graph = new TGraphErrors(nData);
+    for (uint32_t i = 0; i < nData; i++) {
+      auto hist = histVec.at(i);
+      auto maxBin = hist->GetMaximumBin();
+      auto binCenter = hist->GetXaxis()->GetBinCenter(maxBin);
+      auto f1 =
+          new TF1(Form("f1%100d", i), "gaus", binCenter - 10, binCenter + 10);
+      hist->Fit(f1, "QR");
+      auto x = std::stoi(hist->GetTitle());
+      auto y = f1->GetParameter(1) + timeOffset;
+      auto yError = f1->GetParError(2);
+
+      graph->SetPoint(i, x, y);
+      graph->SetPointError(i, 0, yError);
+    }
+    return graph;
+  }
+
+  TLocalHist<TH2D> *histTimeADC[nModules][nChannels];
+};
+
+EVE_ANALYSIS_MODULE(TTimeAlignmentSiModule)
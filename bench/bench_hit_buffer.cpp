@@ -0,0 +1,196 @@
+// Hit store layout benchmark: std::vector<THitData> (AoS, the old layout)
+// against THitBuffer (SoA).
+// Usage: bench_hit_buffer [raw data file (ELIADE_Tree)] [time window (ns)]
+// Without a file, a synthetic run (144 channels, CAEN-like block readout) is
+// used.
+
+#include <TROOT.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TChSettings.hpp"
+#include "TEventData.hpp"
+#include "THitBuffer.hpp"
+#include "THitReader.hpp"
+
+namespace
+{
+std::vector<THitData> GenerateHits(size_t nHits)
+{
+  // Each module is read out in blocks, time ordered inside a module
+  constexpr uint32_t nModules = 9;
+  std::mt19937_64 rng(1);
+  std::exponential_distribution<double_t> gap(1. / 50000.);  // ps
+  std::vector<std::vector<THitData>> modules(nModules);
+  double_t time = 0.;
+  for (size_t i = 0; i < nHits; i++) {
+    time += std::round(gap(rng));  // integer ps, as in THitBuffer
+    uint8_t mod = rng() % nModules;
+    uint16_t adc = rng() % 16000;
+    modules[mod].emplace_back(mod, rng() % 16, time, adc, adc / 2);
+  }
+
+  std::vector<THitData> hits;
+  hits.reserve(nHits);
+  std::vector<size_t> position(nModules, 0);
+  while (hits.size() < nHits) {
+    for (uint32_t mod = 0; mod < nModules; mod++) {
+      auto n = std::min<size_t>(modules[mod].size() - position[mod],
+                                100 + rng() % 1000);
+      for (size_t i = 0; i < n; i++) {
+        hits.push_back(modules[mod][position[mod]++]);
+      }
+    }
+  }
+  return hits;
+}
+
+std::vector<THitData> ReadHits(const std::string &fileName)
+{
+  std::vector<THitData> hits;
+  TFile *file = nullptr;
+  HitData_t hit;
+  auto tree = THitReader::OpenHitTree(fileName, file, hit);
+  if (!tree) {
+    return hits;
+  }
+  const auto nEntries = tree->GetEntries();
+  hits.reserve(nEntries);
+  for (Long64_t i = 0; i < nEntries; i++) {
+    tree->GetEntry(i);
+    hit.Timestamp = std::round(hit.Timestamp);  // integer ps, as in THitBuffer
+    hits.push_back(hit);
+  }
+  file->Close();
+  delete file;
+  return hits;
+}
+
+double_t Elapsed(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double_t, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+  ROOT::EnableThreadSafety();
+
+  double_t timeWindow = 1000.;
+  std::vector<THitData> source;
+  if (argc > 1) {
+    source = ReadHits(argv[1]);
+  } else {
+    source = GenerateHits(20000000);
+  }
+  if (argc > 2) {
+    timeWindow = std::stod(argv[2]);
+  }
+  if (source.size() == 0) {
+    std::cerr << "No hits." << std::endl;
+    return 1;
+  }
+  const auto nHits = source.size();
+  std::cout << "Number of hits: " << nHits << std::endl;
+  std::cout << "Time window: +-" << timeWindow << " ns" << std::endl;
+  const auto timeWindowPs = NsToPs(timeWindow);
+
+  // Trigger: channel 0 of every module
+  auto isTrigger = [](uint8_t channel) { return channel == 0; };
+
+  // AoS
+  auto start = std::chrono::steady_clock::now();
+  std::vector<THitData> aos(source.begin(), source.end());
+  const auto aosFill = Elapsed(start);
+
+  start = std::chrono::steady_clock::now();
+  // Stable: hits at the same time keep the order of the SoA sort, which
+  // breaks ties by index
+  std::stable_sort(aos.begin(), aos.end(),
+                   [](const HitData_t &a, const HitData_t &b) {
+                     return a.Timestamp < b.Timestamp;
+                   });
+  const auto aosSort = Elapsed(start);
+
+  start = std::chrono::steady_clock::now();
+  uint64_t aosCount = 0;
+  uint64_t aosEnergy = 0;
+  for (size_t i = 0; i < nHits; i++) {
+    auto hit = aos.at(i);
+    if (!isTrigger(hit.Channel)) continue;
+    for (auto j = i + 1; j < nHits; j++) {
+      auto next = aos.at(j);
+      if (next.Timestamp - hit.Timestamp > timeWindowPs) break;
+      aosCount++;
+      aosEnergy += next.Energy;
+    }
+  }
+  const auto aosScan = Elapsed(start);
+
+  // SoA
+  start = std::chrono::steady_clock::now();
+  THitBuffer soa;
+  soa.Reserve(nHits);
+  for (const auto &hit : source) {
+    soa.PushBack(hit);
+  }
+  const auto soaFill = Elapsed(start);
+
+  start = std::chrono::steady_clock::now();
+  // Sort (timestamp, index) pairs, then move the columns once
+  std::vector<std::pair<Timestamp_t, uint32_t>> keys(nHits);
+  for (uint32_t i = 0; i < nHits; i++) {
+    keys[i] = {soa.Timestamp[i], i};
+  }
+  std::sort(keys.begin(), keys.end());
+  std::vector<uint32_t> index(nHits);
+  for (uint32_t i = 0; i < nHits; i++) {
+    index[i] = keys[i].second;
+  }
+  std::vector<std::pair<Timestamp_t, uint32_t>>().swap(keys);
+  THitBuffer sorted;
+  sorted.Gather(soa, index);
+  soa.Swap(sorted);
+  const auto soaSort = Elapsed(start);
+  std::vector<uint32_t>().swap(index);
+  sorted.Clear();
+  sorted.ShrinkToFit();
+
+  start = std::chrono::steady_clock::now();
+  uint64_t soaCount = 0;
+  uint64_t soaEnergy = 0;
+  const auto &timestamp = soa.Timestamp;
+  for (size_t i = 0; i < nHits; i++) {
+    if (!isTrigger(soa.Channel[i])) continue;
+    const auto triggerTime = timestamp[i];
+    for (auto j = i + 1; j < nHits; j++) {
+      if (timestamp[j] - triggerTime > timeWindowPs) break;
+      soaCount++;
+      soaEnergy += soa.Energy[j];
+    }
+  }
+  const auto soaScan = Elapsed(start);
+
+  if (aosCount != soaCount || aosEnergy != soaEnergy) {
+    std::cerr << "Mismatch between AoS and SoA results." << std::endl;
+    return 1;
+  }
+
+  std::cout << "Hits in windows: " << soaCount << std::endl;
+  std::cout << "\t\tAoS\tSoA" << std::endl;
+  std::cout << "Bytes/hit\t" << aos.capacity() * sizeof(THitData) / nHits
+            << "\t" << soa.GetMemorySize() / nHits << std::endl;
+  std::cout << "Fill [ms]\t" << aosFill << "\t" << soaFill << std::endl;
+  std::cout << "Sort [ms]\t" << aosSort << "\t" << soaSort << std::endl;
+  std::cout << "Scan [ms]\t" << aosScan << "\t" << soaScan << std::endl;
+
+  return 0;
+}
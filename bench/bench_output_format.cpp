@@ -0,0 +1,193 @@
+// Output format benchmark: TTree (Event_Tree), TTree with compact hits and
+// RNTuple (Event_NTuple) written by TFileWriter and read back by TEventReader.
+// Usage: bench_output_format [number of events] [compression algorithm]
+//        [compression level]
+// The events are synthetic, about 10 hits per event.  Without an algorithm,
+// all of them (Default, ZLIB, LZMA, LZ4, ZSTD) at the level.
+
+#include <TROOT.h>
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TEventBatch.hpp"
+#include "TEventReader.hpp"
+#include "TFileWriter.hpp"
+
+namespace
+{
+std::vector<std::unique_ptr<TEventBatch>> GenerateEvents(size_t nEvents)
+{
+  constexpr size_t batchSize = 10000;
+  std::mt19937_64 rng(1);
+  std::poisson_distribution<uint32_t> nHits(10);
+  std::normal_distribution<double_t> time(0., 200000.);  // ps
+  std::vector<std::unique_ptr<TEventBatch>> batches;
+  for (size_t i = 0; i < nEvents; i++) {
+    if (i % batchSize == 0) {
+      batches.push_back(std::make_unique<TEventBatch>());
+    }
+    auto &batch = *batches.back();
+    TEventInfo info;
+    info.TriggerTime = i * 10000 * kPsPerNs;
+    info.TriggerID = rng() % 32;
+    const auto n = nHits(rng) + 1;
+    for (uint32_t j = 0; j < n; j++) {
+      uint8_t mod = rng() % 9;
+      uint16_t adc = rng() % 16000;
+      batch.Hit.PushBack(
+          THitData(mod, rng() % 16, (j == 0) ? 0. : time(rng), adc, adc / 2));
+      if (mod == 0) info.SiFrontMultiplicity++;
+      if (mod == 1) info.SiBackMultiplicity++;
+      if (mod >= 2 && mod <= 4) info.GammaMultiplicity++;
+      if (mod >= 5) info.NeutronMultiplicity++;
+    }
+    info.SiMultiplicity = info.SiFrontMultiplicity + info.SiBackMultiplicity;
+    info.IsFissionEvent = info.SiMultiplicity > 1;
+    batch.CommitEvent(info);
+  }
+  return batches;
+}
+
+double_t Elapsed(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double_t, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+class TResult
+{
+ public:
+  double_t writeTime = 0.;  // ms
+  double_t readTime = 0.;   // ms
+  uintmax_t fileSize = 0;   // bytes
+  uint64_t nHits = 0;
+  uint64_t energySum = 0;
+};
+
+TResult Run(const std::vector<std::unique_ptr<TEventBatch>> &source,
+            OutputFormat_t format, const TOutputSettings &settings,
+            const std::string &fileName)
+{
+  TResult result;
+
+  // The writer takes the batches over: write copies
+  std::vector<std::unique_ptr<TEventBatch>> batches;
+  for (const auto &batch : source) {
+    batches.push_back(std::make_unique<TEventBatch>());
+    batches.back()->Append(*batch);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    TFileWriter writer(fileName, format, settings);
+    for (auto &batch : batches) {
+      writer.SetData(batch);
+    }
+    writer.Write();
+  }
+  result.writeTime = Elapsed(start);
+  result.fileSize = std::filesystem::file_size(fileName);
+
+  start = std::chrono::steady_clock::now();
+  {
+    TEventReader reader(fileName);
+    const auto nEntries = reader.GetEntries();
+    for (Long64_t i = 0; i < nEntries; i++) {
+      reader.GetEntry(i);
+      result.nHits += reader.Module.size();
+      for (auto energy : reader.Energy) result.energySum += energy;
+    }
+  }
+  result.readTime = Elapsed(start);
+
+  std::filesystem::remove(fileName);
+  return result;
+}
+
+// The three schemas with one compression setting.  False on a mismatch.
+bool RunSchemas(const std::vector<std::unique_ptr<TEventBatch>> &source,
+                size_t nEvents, const std::string &algorithm, int32_t level)
+{
+  TOutputSettings settings;
+  settings.compression = TOutputSettings::GetCompression(algorithm, level);
+  auto compactSettings = settings;
+  compactSettings.compactHits = true;
+
+  auto tree =
+      Run(source, OutputFormat::TTree, settings, "bench_output_tree.root");
+  auto compact = Run(source, OutputFormat::TTree, compactSettings,
+                     "bench_output_compact.root");
+  auto ntuple = Run(source, OutputFormat::RNTuple, settings,
+                    "bench_output_ntuple.root");
+
+  if (tree.nHits != ntuple.nHits || tree.energySum != ntuple.energySum ||
+      tree.nHits != compact.nHits || tree.energySum != compact.energySum) {
+    std::cerr << "Mismatch between the TTree and RNTuple results."
+              << std::endl;
+    return false;
+  }
+
+  std::cout << "Compression: " << algorithm << " " << level << std::endl;
+  std::cout << "\t\t\tTTree\tCompact\tRNTuple" << std::endl;
+  std::cout << "Write [ms]\t\t" << tree.writeTime << "\t" << compact.writeTime
+            << "\t" << ntuple.writeTime << std::endl;
+  std::cout << "Write [kevents/s]\t" << nEvents / tree.writeTime << "\t"
+            << nEvents / compact.writeTime << "\t"
+            << nEvents / ntuple.writeTime << std::endl;
+  std::cout << "File size [MB]\t\t" << tree.fileSize / 1.e6 << "\t"
+            << compact.fileSize / 1.e6 << "\t" << ntuple.fileSize / 1.e6
+            << std::endl;
+  std::cout << "Read [ms]\t\t" << tree.readTime << "\t" << compact.readTime
+            << "\t" << ntuple.readTime << std::endl;
+  std::cout << "Read [kevents/s]\t" << nEvents / tree.readTime << "\t"
+            << nEvents / compact.readTime << "\t" << nEvents / ntuple.readTime
+            << std::endl;
+  return true;
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+  ROOT::EnableThreadSafety();
+
+  size_t nEvents = 1000000;
+  if (argc > 1) {
+    nEvents = std::stoul(argv[1]);
+  }
+  std::vector<std::string> algorithms = {"Default", "ZLIB", "LZMA", "LZ4",
+                                         "ZSTD"};
+  if (argc > 2) {
+    algorithms = {argv[2]};
+  }
+  int32_t level = 5;
+  if (argc > 3) {
+    level = std::stoi(argv[3]);
+  }
+  for (const auto &algorithm : algorithms) {
+    if (TOutputSettings::GetCompression(algorithm, level) ==
+        TOutputSettings::kUnknownCompression) {
+      std::cerr << "Unknown compression algorithm: " << algorithm << std::endl;
+      return 1;
+    }
+  }
+
+  auto source = GenerateEvents(nEvents);
+  uint64_t nHits = 0;
+  for (const auto &batch : source) nHits += batch->Hit.Size();
+  std::cout << "Number of events: " << nEvents << std::endl;
+  std::cout << "Number of hits: " << nHits << std::endl;
+
+  for (const auto &algorithm : algorithms) {
+    if (!RunSchemas(source, nEvents, algorithm, level)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,207 @@
+// Timestamp sort benchmark: THitSorter (radix sort, serial and parallel)
+// against std::sort and std::sort(std::execution::par) of the hit indices.
+// Usage: bench_sort [number of hits] [number of threads] [raw data file]
+// Distributions: uniform random times, block readout of 9 modules (each
+// module in time order, as the digitizers write them), sorted, and locally
+// disordered (sorted, then shuffled within blocks of 16 hits).  With a raw
+// data file, its hits are sorted too.
+
+#include <TROOT.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#if __has_include(<execution>)
+#include <execution>
+#endif
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "THitReader.hpp"
+#include "THitSorter.hpp"
+
+namespace
+{
+std::vector<Timestamp_t> Uniform(size_t nHits, std::mt19937_64 &rng)
+{
+  std::uniform_int_distribution<Timestamp_t> time(0, nHits * 50 * kPsPerNs);
+  std::vector<Timestamp_t> timestamp(nHits);
+  for (auto &t : timestamp) t = time(rng);
+  return timestamp;
+}
+
+std::vector<Timestamp_t> BlockReadout(size_t nHits, std::mt19937_64 &rng)
+{
+  constexpr uint32_t nModules = 9;
+  std::exponential_distribution<double_t> gap(1. / 50000.);  // ps
+  std::vector<std::vector<Timestamp_t>> modules(nModules);
+  double_t time = 0.;
+  for (size_t i = 0; i < nHits; i++) {
+    time += gap(rng);
+    modules[rng() % nModules].push_back(std::llround(time));
+  }
+  std::vector<Timestamp_t> timestamp;
+  timestamp.reserve(nHits);
+  std::vector<size_t> position(nModules, 0);
+  while (timestamp.size() < nHits) {
+    for (uint32_t mod = 0; mod < nModules; mod++) {
+      auto n = std::min<size_t>(modules[mod].size() - position[mod],
+                                100 + rng() % 1000);
+      for (size_t i = 0; i < n; i++) {
+        timestamp.push_back(modules[mod][position[mod]++]);
+      }
+    }
+  }
+  return timestamp;
+}
+
+std::vector<Timestamp_t> Sorted(size_t nHits, std::mt19937_64 &rng)
+{
+  auto timestamp = Uniform(nHits, rng);
+  std::sort(timestamp.begin(), timestamp.end());
+  return timestamp;
+}
+
+std::vector<Timestamp_t> LocallyDisordered(size_t nHits, std::mt19937_64 &rng)
+{
+  auto timestamp = Sorted(nHits, rng);
+  for (size_t i = 0; i + 16 <= nHits; i += 16) {
+    std::shuffle(timestamp.begin() + i, timestamp.begin() + i + 16, rng);
+  }
+  return timestamp;
+}
+
+std::vector<Timestamp_t> ReadTimestamps(const std::string &fileName)
+{
+  std::vector<Timestamp_t> timestamp;
+  TFile *file = nullptr;
+  HitData_t hit;
+  auto tree = THitReader::OpenHitTree(fileName, file, hit);
+  if (!tree) {
+    return timestamp;
+  }
+  const auto nEntries = tree->GetEntries();
+  timestamp.reserve(nEntries);
+  for (Long64_t i = 0; i < nEntries; i++) {
+    tree->GetEntry(i);
+    timestamp.push_back(std::llround(hit.Timestamp));
+  }
+  file->Close();
+  delete file;
+  return timestamp;
+}
+
+double_t Elapsed(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double_t, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Sorts the indices of the hits, returns the time in ms
+double_t Measure(const std::vector<Timestamp_t> &timestamp,
+                 const std::vector<uint32_t> &reference,
+                 const std::function<void(std::vector<uint32_t> &)> &sort)
+{
+  std::vector<uint32_t> index(timestamp.size());
+  std::iota(index.begin(), index.end(), 0);
+  const auto start = std::chrono::steady_clock::now();
+  sort(index);
+  const auto elapsed = Elapsed(start);
+  // Equal timestamps can be in any order for std::sort
+  for (size_t i = 0; i < index.size(); i++) {
+    if (timestamp[index[i]] != timestamp[reference[i]]) {
+      std::cerr << "Not sorted." << std::endl;
+      std::exit(1);
+    }
+  }
+  return elapsed;
+}
+
+void Run(const std::string &name, const std::vector<Timestamp_t> &timestamp,
+         uint32_t nThreads)
+{
+  auto byTime = [&timestamp](uint32_t a, uint32_t b) {
+    return timestamp[a] < timestamp[b];
+  };
+  std::vector<uint32_t> reference(timestamp.size());
+  std::iota(reference.begin(), reference.end(), 0);
+  std::stable_sort(reference.begin(), reference.end(), byTime);
+
+  const auto stdSort = Measure(timestamp, reference, [&](auto &index) {
+    std::sort(index.begin(), index.end(), byTime);
+  });
+#if defined(__cpp_lib_parallel_algorithm)
+  const auto stdParSort = Measure(timestamp, reference, [&](auto &index) {
+    std::sort(std::execution::par, index.begin(), index.end(), byTime);
+  });
+#else
+  const auto stdParSort = 0.;
+#endif
+
+  THitSorter serial(1);
+  const auto radix = Measure(timestamp, reference, [&](auto &index) {
+    serial.Sort(timestamp, index);
+  });
+  // The same stable order as std::stable_sort
+  {
+    std::vector<uint32_t> index(timestamp.size());
+    std::iota(index.begin(), index.end(), 0);
+    serial.Sort(timestamp, index);
+    if (index != reference) {
+      std::cerr << "THitSorter is not stable." << std::endl;
+      std::exit(1);
+    }
+  }
+  THitSorter parallel(nThreads);
+  const auto parRadix = Measure(timestamp, reference, [&](auto &index) {
+    parallel.Sort(timestamp, index);
+  });
+
+  const char *path[] = {"sorted", "insertion", "radix"};
+  std::cout << name << "\t" << stdSort << "\t" << stdParSort << "\t" << radix
+            << "\t" << parRadix << "\t"
+            << path[static_cast<int>(parallel.GetLastPath())] << " "
+            << parallel.GetNPasses() << std::endl;
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+  ROOT::EnableThreadSafety();
+
+  size_t nHits = 20000000;
+  if (argc > 1) {
+    nHits = std::stoul(argv[1]);
+  }
+  uint32_t nThreads = std::thread::hardware_concurrency();
+  if (argc > 2) {
+    nThreads = std::stoul(argv[2]);
+  }
+  std::cout << "Number of hits: " << nHits << std::endl;
+  std::cout << "Number of threads: " << nThreads << std::endl;
+#if !defined(__cpp_lib_parallel_algorithm)
+  std::cout << "std::execution::par is not available" << std::endl;
+#endif
+
+  std::mt19937_64 rng(1);
+  std::cout << "[ms]\t\tstd\tstd par\tradix\tpar radix\tpath passes"
+            << std::endl;
+  Run("Uniform\t", Uniform(nHits, rng), nThreads);
+  Run("Block readout", BlockReadout(nHits, rng), nThreads);
+  Run("Sorted\t", Sorted(nHits, rng), nThreads);
+  Run("Local disorder", LocallyDisordered(nHits, rng), nThreads);
+  if (argc > 3) {
+    auto timestamp = ReadTimestamps(argv[3]);
+    if (timestamp.size() > 0) {
+      Run("Raw data file", timestamp, nThreads);
+    }
+  }
+
+  return 0;
+}
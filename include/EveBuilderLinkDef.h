@@ -0,0 +1,8 @@
+#ifdef __CLING__
+#pragma link off all globals;
+#pragma link off all classes;
+#pragma link off all functions;
+
+#pragma link C++ class THitRecord+;
+#pragma link C++ class std::vector<THitRecord>+;
+#endif
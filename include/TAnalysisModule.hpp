@@ -0,0 +1,39 @@
+#ifndef TAnalysisModule_hpp
+#define TAnalysisModule_hpp 1
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TEventReader.hpp"
+
+// An analysis run by TAnalysisRunner, compiled as a plugin (shared library)
+// which defines its module with EVE_ANALYSIS_MODULE().  Process() is called
+// by several threads at once, each with its worker number: the module keeps
+// per-worker state (e.g. TLocalHist) and merges it in Finish().
+class TAnalysisModule
+{
+ public:
+  TAnalysisModule() {};
+  virtual ~TAnalysisModule() {};
+
+  // The branches read for Process(), all if empty
+  virtual std::vector<std::string> GetFields() const { return {}; }
+
+  // Before the first event, Process() will get worker 0 ... nWorkers - 1
+  virtual void Init(uint32_t nWorkers) = 0;
+  virtual void Process(TEventReader &event, uint32_t worker) = 0;
+  // After the last event, in the main thread: merge, fit, draw, write
+  virtual void Finish() = 0;
+};
+typedef TAnalysisModule AnalysisModule_t;
+
+// The factory looked up by TAnalysisRunner::LoadModule()
+typedef TAnalysisModule *(*AnalysisModuleFactory_t)();
+#define EVE_ANALYSIS_MODULE(ModuleClass)             \
+  extern "C" TAnalysisModule *CreateAnalysisModule() \
+  {                                                  \
+    return new ModuleClass();                        \
+  }
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef TAnalysisRunner_hpp
+#define TAnalysisRunner_hpp 1
+
+#include <TROOT.h>
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TAnalysisModule.hpp"
+
+// Runs an analysis module over all events of a set of event files.  The
+// files are cut into entry ranges on TTree cluster boundaries, and the
+// ranges, largest first, are the tasks of a TWorkStealingPool: a big file
+// is shared by all threads instead of being the tail of the run.
+class TAnalysisRunner
+{
+ public:
+  TAnalysisRunner(uint32_t nThreads);
+  ~TAnalysisRunner() {};
+
+  void AddFile(const std::string &fileName) { fFileList.push_back(fileName); }
+  // The files of the directory with the key in their name
+  void AddDirectory(const std::string &directory,
+                    const std::string &key = "events_t");
+  uint32_t GetNFiles() const { return fFileList.size(); }
+
+  // Returns the number of events processed
+  uint64_t Run(TAnalysisModule &module);
+
+  // path: a plugin, or the name of a plugin next to the executable
+  // ("reader" -> reader.so).  Null if it cannot be loaded.
+  static std::unique_ptr<TAnalysisModule> LoadModule(const std::string &path);
+
+  // Ranges per thread: enough to balance, few enough to keep the files open
+  static constexpr uint32_t kRangesPerThread = 8;
+
+ private:
+  class TEntryRange
+  {
+   public:
+    uint32_t file;
+    Long64_t first;
+    Long64_t last;
+  };
+  std::vector<TEntryRange> GetEntryRanges(
+      const std::vector<std::string> &fields, uint64_t &nEntries) const;
+
+  uint32_t fNThreads;
+  std::vector<std::string> fFileList;
+};
+typedef TAnalysisRunner AnalysisRunner_t;
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef TBlockCounts_hpp
+#define TBlockCounts_hpp 1
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+// Sparse integer bin counts.  The bins are cut in blocks of kBlockSize,
+// a block is allocated at its first count: the empty regions of a large
+// 2D map cost one pointer per block.  32-bit counts; the rare bin which
+// goes over 2^32 keeps its carries aside, so no count is lost.
+class TBlockCounts
+{
+ public:
+  TBlockCounts(size_t nBins = 0) { Resize(nBins); };
+  ~TBlockCounts() {};
+
+  static constexpr uint32_t kBlockBits = 12;
+  static constexpr size_t kBlockSize = size_t(1) << kBlockBits;  // 16 kB
+
+  // Clears the counts
+  void Resize(size_t nBins)
+  {
+    Clear();
+    fNBins = nBins;
+    fBlocks.resize((nBins + kBlockSize - 1) >> kBlockBits);
+  }
+
+  void Add(size_t bin)
+  {
+    auto &block = fBlocks[bin >> kBlockBits];
+    if (!block) block = std::make_unique<uint32_t[]>(kBlockSize);
+    if (++block[bin & (kBlockSize - 1)] == 0) fCarry[bin]++;
+    fEntries++;
+  }
+
+  // Adds the counts of the other, same number of bins
+  void Add(const TBlockCounts &other)
+  {
+    for (size_t i = 0; i < other.fBlocks.size(); i++) {
+      const auto &from = other.fBlocks[i];
+      if (!from) continue;
+      auto &to = fBlocks[i];
+      if (!to) to = std::make_unique<uint32_t[]>(kBlockSize);
+      for (size_t j = 0; j < kBlockSize; j++) {
+        const auto sum = to[j] + from[j];
+        if (sum < to[j]) fCarry[(i << kBlockBits) + j]++;
+        to[j] = sum;
+      }
+    }
+    for (const auto &[bin, carry] : other.fCarry) fCarry[bin] += carry;
+    fEntries += other.fEntries;
+  }
+
+  uint64_t Get(size_t bin) const
+  {
+    const auto &block = fBlocks[bin >> kBlockBits];
+    if (!block) return 0;
+    uint64_t count = block[bin & (kBlockSize - 1)];
+    const auto carry = fCarry.find(bin);
+    if (carry != fCarry.end()) count += uint64_t(carry->second) << 32;
+    return count;
+  }
+
+  // Calls f(bin, count) for every bin with a count, in order
+  template <typename F>
+  void ForEach(F f) const
+  {
+    for (size_t i = 0; i < fBlocks.size(); i++) {
+      if (!fBlocks[i]) continue;
+      for (size_t j = 0; j < kBlockSize; j++) {
+        const auto bin = (i << kBlockBits) + j;
+        if (bin >= fNBins) break;
+        const auto count = Get(bin);
+        if (count > 0) f(bin, count);
+      }
+    }
+  }
+
+  // Releases the blocks
+  void Clear()
+  {
+    for (auto &block : fBlocks) block.reset();
+    fCarry.clear();
+    fEntries = 0;
+  }
+
+  uint64_t GetEntries() const { return fEntries; }
+  size_t GetNBins() const { return fNBins; }
+  size_t GetBytes() const
+  {
+    size_t nBlocks = 0;
+    for (const auto &block : fBlocks) nBlocks += bool(block);
+    return nBlocks * kBlockSize * sizeof(uint32_t) +
+           fBlocks.size() * sizeof(fBlocks[0]);
+  }
+
+ private:
+  size_t fNBins = 0;
+  std::vector<std::unique_ptr<uint32_t[]>> fBlocks;
+  std::map<size_t, uint32_t> fCarry;  // 2^32 counts each
+  uint64_t fEntries = 0;
+};
+typedef TBlockCounts BlockCounts_t;
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef TCalibrationTable_hpp
+#define TCalibrationTable_hpp 1
+
+#include <TAxis.h>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "TChSettings.hpp"
+
+// Calibrated energy and histogram bin of every 16-bit ADC value of one
+// channel.  A fill is then one indexed load instead of the polynomial and
+// the binary search in the variable bins.  The bins are those of
+// TAxis::FindFixBin for the same energies, so the histogram does not change.
+class TCalibrationTable
+{
+ public:
+  TCalibrationTable(const TChSettings &chSetting, const TAxis *axis)
+      : fEnergy(kNADC), fBin(kNADC)
+  {
+    for (uint32_t adc = 0; adc < kNADC; adc++) {
+      fEnergy[adc] = chSetting.GetCalibratedEnergy(adc);
+      fBin[adc] = axis->FindFixBin(fEnergy[adc]);
+    }
+  };
+  ~TCalibrationTable() {};
+
+  static constexpr uint32_t kNADC = 65536;
+
+  double_t GetEnergy(uint16_t adc) const { return fEnergy[adc]; }
+  int32_t GetBin(uint16_t adc) const { return fBin[adc]; }
+
+ private:
+  std::vector<double_t> fEnergy;
+  std::vector<int32_t> fBin;
+};
+typedef TCalibrationTable CalibrationTable_t;
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef TCampaign_hpp
+#define TCampaign_hpp 1
+
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+// One run and a range of its versions, built by one event-builder process
+class TWorkUnit
+{
+ public:
+  TWorkUnit() {};
+  TWorkUnit(uint32_t run, uint32_t start, uint32_t end)
+      : runNumber(run), startVersion(start), endVersion(end) {};
+  ~TWorkUnit() {};
+
+  uint32_t runNumber = 0;
+  uint32_t startVersion = 0;
+  uint32_t endVersion = 0;
+  uint32_t attempts = 0;  // failed or expired so far
+
+  std::string GetName() const
+  {
+    return "run" + std::to_string(runNumber) + "_v" +
+           std::to_string(startVersion) + "-" + std::to_string(endVersion);
+  }
+
+  nlohmann::json ToJson() const
+  {
+    return {{"Unit", GetName()},
+            {"RunNumber", runNumber},
+            {"StartVersion", startVersion},
+            {"EndVersion", endVersion},
+            {"Attempts", attempts}};
+  }
+  static TWorkUnit FromJson(const nlohmann::json &j)
+  {
+    TWorkUnit unit(j.at("RunNumber"), j.at("StartVersion"),
+                   j.at("EndVersion"));
+    unit.attempts = j.value("Attempts", 0);
+    return unit;
+  }
+};
+typedef TWorkUnit WorkUnit_t;
+
+// Campaign of many runs on many nodes, through a lease directory on a shared
+// filesystem:
+//   todo/<unit>.json             units waiting for a worker
+//   running/<unit>.json.<attempt>  taken by a worker (atomic rename),
+//                                  touched by it while the unit is built
+//   done/<unit>.json               manifest: output files, events, time, host
+//   failed/<unit>.json             failed more than MaxRetries times
+//   out/<unit>/<attempt>/          output files and log of one attempt
+//   settings.json                  settings of the units
+// A worker builds each unit in a child event-builder process, so a crash
+// only fails the unit.  A failed unit, or one whose lease has not been
+// touched for LeaseTimeout (node lost), goes back to todo.
+// The worker and the coordinator end a lease by renaming it to
+// <lease>.taken, which only one of them can do; the taken lease stays in
+// running/ until the unit is in todo/, done/ or failed/.  A worker whose
+// lease was taken by the coordinator drops its result.
+class TCampaign
+{
+ public:
+  TCampaign(const std::string &directory);
+  ~TCampaign() {};
+
+  // Coordinator: creates the lease directory with the settings and the
+  // units.  False if it already holds a campaign.
+  bool Create(const nlohmann::json &settings,
+              const std::vector<TWorkUnit> &units);
+  // Coordinator: puts back the expired units until every unit is done or
+  // failed, then writes manifest.json.  Returns the number of failed units.
+  uint32_t Coordinate(double_t leaseTimeout);
+
+  // Worker: builds units until none is left.  Returns the number of units
+  // which failed here.
+  uint32_t Work(const std::string &executable);
+
+  // s, the workers touch their leases at this interval
+  static constexpr double_t kHeartbeatInterval = 10.;
+  static constexpr double_t kPollInterval = 5.;
+
+ private:
+  // attempt: <host>.<pid>.<n>, unique to this claim
+  bool Claim(TWorkUnit &unit, std::filesystem::path &lease,
+             std::string &attempt);
+  std::filesystem::path GetOutputDirectory(const TWorkUnit &unit,
+                                           const std::string &attempt) const
+  {
+    return fDirectory / "out" / unit.GetName() / attempt;
+  }
+  int32_t Build(const TWorkUnit &unit, const std::filesystem::path &lease,
+                const std::string &attempt, const std::string &executable);
+  // False if the lease was already taken (by the coordinator, or by the
+  // worker at the end of the unit)
+  static bool TakeLease(const std::filesystem::path &lease,
+                        std::filesystem::path &taken);
+  // Back to todo, or to failed after MaxRetries attempts.  False if the
+  // file could not be written.
+  bool Requeue(TWorkUnit unit, const nlohmann::json &report);
+  void ExpireLeases(double_t leaseTimeout);
+  void WriteManifest();
+
+  static bool WriteJson(const std::filesystem::path &path,
+                        const nlohmann::json &j);
+  static bool ReadJson(const std::filesystem::path &path, nlohmann::json &j);
+  // Number of <unit>.json files (leases included) in the directory
+  static uint32_t CountUnits(const std::filesystem::path &directory);
+
+  std::filesystem::path fDirectory;
+  std::string fHost;
+  uint32_t fMaxRetries = 2;
+  uint32_t fNClaims = 0;
+};
+typedef TCampaign Campaign_t;
+
+#endif
@@ -16,6 +16,7 @@ class TChSettings
   bool isEventTrigger = false;
   uint32_t coincidenceID = 0;
   int32_t detectorID = 0;
+  std::string detectorType = "Unknown";  // SiFront, SiBack, Gamma, Neutron
   uint32_t mod = 0;
   uint32_t ch = 0;
   double_t timeOffset = 0.;
@@ -38,12 +39,18 @@ class TChSettings
   double_t p2 = 0.;
   double_t p3 = 0.;
 
+  double_t GetCalibratedEnergy(double_t adc) const
+  {
+    return p0 + p1 * adc + p2 * adc * adc + p3 * adc * adc * adc;
+  };
+
   void Print()
   {
     std::cout << "Module: " << mod << "\tChannel: " << ch << std::endl;
     std::cout << "\tTime Offset: " << timeOffset << std::endl;
     std::cout << "\tIs Event Trigger: " << isEventTrigger << std::endl;
     std::cout << "\tDetector ID: " << detectorID << std::endl;
+    std::cout << "\tDetector Type: " << detectorType << std::endl;
     std::cout << "\tHas AC: " << hasAC << std::endl;
     std::cout << "\tAC Module: " << ACMod << "\tAC Channel: " << ACCh
               << std::endl;
@@ -56,6 +63,21 @@ class TChSettings
     std::cout << std::endl;
   };
 
+  // Detector type of the E9 setup, for the files without "DetectorType"
+  static std::string GetDefaultDetectorType(uint32_t mod)
+  {
+    if (mod == 0) {
+      return "SiFront";
+    } else if (mod == 1) {
+      return "SiBack";
+    } else if (mod >= 2 && mod <= 4) {
+      return "Gamma";
+    } else if (mod >= 5 && mod <= 9) {
+      return "Neutron";
+    }
+    return "Unknown";
+  };
+
   static void GenerateTemplate(uint32_t nMods = 10, uint32_t nChs = 16)
   {
     nlohmann::json result;
@@ -65,6 +87,7 @@ class TChSettings
         nlohmann::json ch;
         ch["IsEventTrigger"] = false;
         ch["DetectorID"] = 0;
+        ch["DetectorType"] = GetDefaultDetectorType(i);
         ch["Module"] = i;
         ch["Channel"] = j;
         ch["HasAC"] = false;
@@ -115,6 +138,8 @@ class TChSettings
         chSetting.coincidenceID = ch["CoincidenceID"];
         chSetting.detectorID = ch["DetectorID"];
         chSetting.mod = ch["Module"];
+        chSetting.detectorType =
+            ch.value("DetectorType", GetDefaultDetectorType(chSetting.mod));
         chSetting.ch = ch["Channel"];
         chSetting.timeOffset = ch["TimeOffset"];
         chSetting.hasAC = ch["HasAC"];
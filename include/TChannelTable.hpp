@@ -0,0 +1,109 @@
+#ifndef TChannelTable_hpp
+#define TChannelTable_hpp 1
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TChSettings.hpp"
+#include "TEventData.hpp"
+
+enum class HitType : uint8_t {
+  SiFront = 0,
+  SiBack = 1,
+  Gamma = 2,
+  Neutron = 3,
+  Unknown = 4,
+};
+typedef HitType HitType_t;
+
+// What the event builder needs of one channel, 16 bytes
+class TChannelInfo
+{
+ public:
+  TChannelInfo() {};
+  ~TChannelInfo() {};
+
+  Timestamp_t timeOffset = 0;  // ps
+  uint16_t thresholdADC = 0;
+  uint16_t ACIndex = 0xFFFF;  // table index of the AC partner, 0xFFFF: none
+  uint8_t detectorID = 0;
+  HitType_t hitType = HitType::Unknown;
+  bool isEventTrigger = false;
+  bool isValid = false;  // false: not in chSettings.json
+};
+typedef TChannelInfo ChannelInfo_t;
+
+// Flat per-channel table built from chSettings.json, indexed by
+// module * kNChannels + channel.  Small enough to stay in L1 for the whole
+// event building.
+class TChannelTable
+{
+ public:
+  static constexpr uint32_t kNChannels = 16;
+
+  TChannelTable() {};
+  TChannelTable(const std::vector<std::vector<TChSettings>> &settings)
+  {
+    fTable.resize(settings.size() * kNChannels);
+    for (uint32_t mod = 0; mod < settings.size(); mod++) {
+      for (uint32_t ch = 0; ch < settings[mod].size() && ch < kNChannels;
+           ch++) {
+        const auto &chSettings = settings[mod][ch];
+        auto &info = fTable[GetIndex(mod, ch)];
+        info.timeOffset = NsToPs(chSettings.timeOffset);
+        info.thresholdADC = chSettings.thresholdADC;
+        if (chSettings.hasAC && chSettings.ACMod < settings.size() &&
+            chSettings.ACCh < kNChannels) {
+          info.ACIndex = GetIndex(chSettings.ACMod, chSettings.ACCh);
+        }
+        info.detectorID = chSettings.detectorID;
+        info.hitType = GetHitType(chSettings.detectorType);
+        info.isEventTrigger = chSettings.isEventTrigger;
+        info.isValid = true;
+      }
+    }
+  };
+  ~TChannelTable() {};
+
+  static uint32_t GetIndex(uint32_t mod, uint32_t ch)
+  {
+    return mod * kNChannels + ch;
+  }
+
+  // Number of indices, (module, channel) not in the table give Size() or more
+  uint32_t Size() const { return fTable.size(); }
+
+  bool Contains(uint8_t mod, uint8_t ch) const
+  {
+    return ch < kNChannels && GetIndex(mod, ch) < fTable.size() &&
+           fTable[GetIndex(mod, ch)].isValid;
+  }
+
+  // No range check: the hits are checked with Contains() when read
+  const TChannelInfo &Get(uint8_t mod, uint8_t ch) const
+  {
+    return fTable[GetIndex(mod, ch)];
+  }
+  const TChannelInfo &operator[](uint32_t index) const { return fTable[index]; }
+
+  static HitType_t GetHitType(const std::string &detectorType)
+  {
+    if (detectorType == "SiFront") {
+      return HitType::SiFront;
+    } else if (detectorType == "SiBack") {
+      return HitType::SiBack;
+    } else if (detectorType == "Gamma") {
+      return HitType::Gamma;
+    } else if (detectorType == "Neutron") {
+      return HitType::Neutron;
+    }
+    return HitType::Unknown;
+  }
+
+ private:
+  std::vector<TChannelInfo> fTable;
+};
+typedef TChannelTable ChannelTable_t;
+
+#endif
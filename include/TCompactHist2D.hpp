@@ -0,0 +1,132 @@
+#ifndef TCompactHist2D_hpp
+#define TCompactHist2D_hpp 1
+
+#include <TAxis.h>
+#include <TH2.h>
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TBlockCounts.hpp"
+#include "THistStats.hpp"
+
+// Large 2D map filled by several worker threads, like TLocalHist, but
+// without a dense ROOT histogram behind it.  The workers and the merged
+// total count into sparse 32-bit blocks (TBlockCounts); the TH2D, 8 bytes
+// for every bin, is only made by Get(), for the maps which are looked at.
+class TCompactHist2D
+{
+ public:
+  TCompactHist2D(const char *name, const char *title, int32_t nBinsX,
+                 double_t xMin, double_t xMax, int32_t nBinsY, double_t yMin,
+                 double_t yMax, uint32_t nWorkers)
+      : fName(name),
+        fTitle(title),
+        fXAxis(nBinsX, xMin, xMax),
+        fYAxis(nBinsY, yMin, yMax),
+        fNCellsX(nBinsX + 2),
+        fTotal(size_t(nBinsX + 2) * (nBinsY + 2)),
+        fWorker(nWorkers)
+  {
+    for (auto &worker : fWorker) worker.counts.Resize(fTotal.GetNBins());
+  };
+  ~TCompactHist2D() {};
+
+  void SetXTitle(const char *title) { fXTitle = title; }
+  void SetYTitle(const char *title) { fYTitle = title; }
+
+  void Fill(uint32_t worker, double_t x, double_t y)
+  {
+    const auto binX = fXAxis.FindFixBin(x);
+    const auto binY = fYAxis.FindFixBin(y);
+    auto &local = fWorker[worker];
+    local.counts.Add(binX + fNCellsX * binY);
+    if (THistStats::IsInRange(binX, fXAxis.GetNbins()) &&
+        THistStats::IsInRange(binY, fYAxis.GetNbins())) {
+      local.stats.Add(x, y);
+    }
+  }
+
+  // Adds the counts of the workers to the total and clears them
+  void Merge()
+  {
+    for (auto &worker : fWorker) {
+      fTotal.Add(worker.counts);
+      fTotalStats.Add(worker.stats);
+      worker.counts.Clear();
+      worker.stats.Clear();
+    }
+    if (fHist) Export();
+  }
+
+  // The ROOT histogram of the merged counts, made at the first call
+  TH2D *Get()
+  {
+    if (!fHist) {
+      fHist = new TH2D(fName.c_str(), fTitle.c_str(), fXAxis.GetNbins(),
+                       fXAxis.GetXmin(), fXAxis.GetXmax(), fYAxis.GetNbins(),
+                       fYAxis.GetXmin(), fYAxis.GetXmax());
+      fHist->SetXTitle(fXTitle.c_str());
+      fHist->SetYTitle(fYTitle.c_str());
+      Export();
+    }
+    return fHist;
+  }
+
+  // Writes the TH2D to the current directory.  One made only for this is
+  // deleted after: the maps can be written one by one.
+  void Write()
+  {
+    if (fHist) {
+      fHist->Write();
+      return;
+    }
+    Get()->Write();
+    delete fHist;
+    fHist = nullptr;
+  }
+
+  // Memory of the counts, the ROOT histogram not included
+  size_t GetBytes() const
+  {
+    auto bytes = fTotal.GetBytes();
+    for (const auto &worker : fWorker) bytes += worker.counts.GetBytes();
+    return bytes;
+  }
+
+ private:
+  void Export()
+  {
+    fTotal.ForEach([this](size_t bin, uint64_t count) {
+      fHist->SetBinContent(bin, count);
+    });
+    double_t stats[TH1::kNstat] = {};
+    fTotalStats.AddTo(stats);
+    fHist->PutStats(stats);
+    fHist->SetEntries(fTotal.GetEntries());
+  }
+
+  std::string fName;
+  std::string fTitle;
+  std::string fXTitle;
+  std::string fYTitle;
+  TAxis fXAxis;
+  TAxis fYAxis;
+  int32_t fNCellsX;
+  TBlockCounts fTotal;
+  THistStats fTotalStats;
+  // Own cache line per worker
+  class alignas(64) TWorkerCounts
+  {
+   public:
+    TBlockCounts counts;
+    THistStats stats;
+  };
+  std::vector<TWorkerCounts> fWorker;
+  TH2D *fHist = nullptr;
+};
+typedef TCompactHist2D CompactHist2D_t;
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef TEventBatch_hpp
+#define TEventBatch_hpp 1
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "TEventData.hpp"
+#include "THitBuffer.hpp"
+
+// Scalars of one event.  The hits are stored in the batch.
+class TEventInfo
+{
+ public:
+  TEventInfo() {};
+  ~TEventInfo() {};
+
+  bool IsFissionEvent = false;
+  uint8_t TriggerID = 0;
+  uint8_t SiFrontMultiplicity = 0;
+  uint8_t SiBackMultiplicity = 0;
+  uint8_t SiMultiplicity = 0;
+  uint8_t GammaMultiplicity = 0;
+  uint8_t NeutronMultiplicity = 0;
+  Timestamp_t TriggerTime = 0;  // ps
+};
+typedef TEventInfo EventInfo_t;
+
+// Events stored in CSR layout: the hits of the event i are
+// Hit[HitOffset[i], HitOffset[i + 1]) in one hit buffer, so that building an
+// event does not allocate.  Clear() keeps the memory for the next use.
+// The hit timestamps are relative to TriggerTime.
+class TEventBatch
+{
+ public:
+  TEventBatch() { HitOffset.push_back(0); };
+  ~TEventBatch() {};
+
+  std::vector<TEventInfo> Event;
+  std::vector<uint32_t> HitOffset;
+  THitBuffer Hit;
+
+  size_t Size() const { return Event.size(); }
+  uint32_t GetNHits(size_t i) const { return HitOffset[i + 1] - HitOffset[i]; }
+
+  void Clear()
+  {
+    Event.clear();
+    HitOffset.resize(1);
+    Hit.Clear();
+  }
+
+  // The hits added since the last event make the new event
+  void CommitEvent(const TEventInfo &info)
+  {
+    Event.push_back(info);
+    HitOffset.push_back(Hit.Size());
+  }
+
+  // Drop the hits added since the last event
+  void RollBack() { Hit.Resize(HitOffset.back()); }
+
+  // Copy of the events from firstEvent to the end of src at the end
+  void Append(const TEventBatch &src, size_t firstEvent = 0)
+  {
+    const auto hitBegin = src.HitOffset[firstEvent];
+    const auto shift = Hit.Size() - hitBegin;
+    Event.insert(Event.end(), src.Event.begin() + firstEvent, src.Event.end());
+    for (auto i = firstEvent + 1; i < src.HitOffset.size(); i++) {
+      HitOffset.push_back(src.HitOffset[i] + shift);
+    }
+    Hit.Append(src.Hit, hitBegin, src.HitOffset.back());
+  }
+
+  TEventData GetEvent(size_t i) const
+  {
+    TEventData eventData;
+    const auto &info = Event[i];
+    eventData.IsFissionEvent = info.IsFissionEvent;
+    eventData.TriggerID = info.TriggerID;
+    eventData.SiFrontMultiplicity = info.SiFrontMultiplicity;
+    eventData.SiBackMultiplicity = info.SiBackMultiplicity;
+    eventData.SiMultiplicity = info.SiMultiplicity;
+    eventData.GammaMultiplicity = info.GammaMultiplicity;
+    eventData.NeutronMultiplicity = info.NeutronMultiplicity;
+    eventData.TriggerTime = info.TriggerTime;
+    for (auto j = HitOffset[i]; j < HitOffset[i + 1]; j++) {
+      eventData.HitData.push_back(Hit.GetHit(j));
+    }
+    return eventData;
+  }
+
+  size_t GetMemorySize() const
+  {
+    return Event.capacity() * sizeof(TEventInfo) +
+           HitOffset.capacity() * sizeof(uint32_t) + Hit.GetMemorySize();
+  }
+};
+typedef TEventBatch EventBatch_t;
+
+// Recycles the event batches, and their memory, from the writers back to the
+// builders.  Thread safe.
+class TEventBatchPool
+{
+ public:
+  TEventBatchPool(size_t maxFree = 8) : fMaxFree(maxFree) {};
+  ~TEventBatchPool() {};
+
+  std::unique_ptr<TEventBatch> Acquire()
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    if (fFree.size() == 0) {
+      return std::make_unique<TEventBatch>();
+    }
+    auto batch = std::move(fFree.back());
+    fFree.pop_back();
+    return batch;
+  }
+
+  void Release(std::unique_ptr<TEventBatch> batch)
+  {
+    if (!batch) return;
+    batch->Clear();
+    std::lock_guard<std::mutex> lock(fMutex);
+    if (fFree.size() < fMaxFree) {
+      fFree.push_back(std::move(batch));
+    }
+  }
+
+ private:
+  std::mutex fMutex;
+  std::vector<std::unique_ptr<TEventBatch>> fFree;
+  size_t fMaxFree;
+};
+
+#endif
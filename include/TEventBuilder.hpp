@@ -1,21 +1,28 @@
 #ifndef TEventBuilder_hpp
 #define TEventBuilder_hpp 1
 
+#include <algorithm>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "TChSettings.hpp"
+#include "TChannelTable.hpp"
+#include "TEventBatch.hpp"
 #include "TEventData.hpp"
+#include "THitBuffer.hpp"
+#include "THitReader.hpp"
+#include "THitSorter.hpp"
+#include "TMemoryBudget.hpp"
 
-enum class HitType {
-  SiFront = 0,
-  SiBack = 1,
-  Gamma = 2,
-  Neutron = 3,
-  Unknown = 4,
+// What to do with a trigger inside the window of the previous event
+enum class OverlapPolicy {
+  DeadTime = 0,      // no trigger up to 2 * window after an event trigger
+  AllowOverlap = 1,  // every trigger makes an event, hits can be shared
+  Merge = 2,         // overlapping windows make one event
 };
-typedef HitType HitType_t;
+typedef OverlapPolicy OverlapPolicy_t;
 
 class TEventBuilder
 {
@@ -25,27 +32,123 @@ class TEventBuilder
                 const std::vector<std::vector<TChSettings>> &settings);
   ~TEventBuilder();
 
-  uint32_t LoadHits();
+  // With a memory budget, the hits are reserved first.  waitForMemory false:
+  // nothing is loaded if they do not fit now (IsLoadDeferred() then true).
+  uint32_t LoadHits(bool waitForMemory = true);
+  bool IsLoadDeferred() const { return fLoadDeferred; }
+  // Hits from memory instead of LoadHits() (checks, benchmarks): channels of
+  // the channel settings only, time offsets applied, any order
+  void SetHitData(const THitBuffer &hits);
+  // With more than one thread, the hits are split into time slices built in
+  // parallel and joined into the same events as the serial build.
   uint32_t EventBuild();
 
-  std::unique_ptr<std::vector<TEventData>> GetEventData()
+  // Streaming mode: read hits chunk by chunk and hand over the events whose
+  // +-window is closed after every chunk.  Memory is bounded by the reorder
+  // buffer (chunk size + max time disorder + time window).
+  typedef std::function<void(std::unique_ptr<TEventBatch> &)> EventSink_t;
+  uint32_t StreamBuild(const EventSink_t &sink);
+  // Same on a reader spanning several files (run-stream mode).  The reorder
+  // buffer carries the hits over the file boundaries.
+  uint32_t StreamBuild(THitReader &reader, const EventSink_t &sink);
+  // Same on any source of chunks, which returns false at the end of the
+  // stream.  The hits are as in SetHitData().
+  typedef std::function<bool(THitBuffer &)> ChunkSource_t;
+  uint32_t StreamBuild(const ChunkSource_t &source, const EventSink_t &sink);
+
+  // The memory of the events is handed over to the caller (to the writer)
+  std::unique_ptr<TEventBatch> GetEventData()
   {
+    fEventReservation.Release();
     return std::move(fEventData);
   }
 
-  void SetTimeWindow(double_t timeWindow) { fTimeWindow = timeWindow; }
+  // Event batches are taken from the pool when given, to reuse their memory
+  void SetBatchPool(TEventBatchPool *pool) { fBatchPool = pool; }
+  // The loaded hits and the events built count in the budget when given
+  void SetMemoryBudget(TMemoryBudget *budget) { fMemoryBudget = budget; }
+
+  // ns
+  void SetTimeWindow(double_t timeWindow) { fTimeWindow = NsToPs(timeWindow); }
+  void SetOverlapPolicy(OverlapPolicy_t policy) { fOverlapPolicy = policy; }
+  // Apply new time offsets to the loaded hits without sorting them again
+  void UpdateTimeOffsets(const std::vector<std::vector<TChSettings>> &settings);
+  void SetChunkSize(uint32_t chunkSize) { fChunkSize = chunkSize; }
+  // ns
+  void SetMaxTimeDisorder(double_t maxTimeDisorder)
+  {
+    fMaxTimeDisorder = NsToPs(maxTimeDisorder);
+  }
+  void SetReadAheadDepth(uint32_t depth) { fReadAheadDepth = depth; }
+  void SetNThreads(uint32_t nThreads)
+  {
+    fNThreads = std::max(nThreads, 1u);
+    fSorter.SetNThreads(fNThreads);
+  }
+
+  uint64_t GetNLateHits() const { return fNLateHits; }
+  uint32_t GetNUnorderedStreams() const { return fNUnorderedStreams; }
+  // Hits of channels not in chSettings.json (dropped) and of channels with an
+  // unknown DetectorType (in the events, not in the multiplicities)
+  uint64_t GetNUnknownChannelHits() const { return fNUnknownChannelHits; }
+  uint64_t GetNUnknownTypeHits() const { return fNUnknownTypeHits; }
+  // The hits of LoadHits(): sorted, time offsets applied
+  const THitBuffer &GetHitData() const { return fHitData; }
 
  private:
-  std::vector<THitData> fHitData;
-  void CheckHitData();
+  THitBuffer fHitData;
+  THitBuffer fSortBuffer;
+  THitSorter fSorter;
+  void SortHitData(size_t nSorted);
+
+  TMemoryBudget *fMemoryBudget = nullptr;
+  TMemoryReservation fHitReservation;    // loader stage
+  TMemoryReservation fEventReservation;  // builder stage
+  bool fLoadDeferred = false;
+  void ChargeMemory(TMemoryReservation &reservation, MemoryStage_t stage,
+                    size_t bytes);
+
+  // Output of BuildEvents().  For the slices of the parallel build, every
+  // trigger taken (also for the events rolled back) is recorded with the
+  // number of events and unknown type hits before it, to join the slices.
+  class TBuildOutput
+  {
+   public:
+    TEventBatch *eventData = nullptr;
+    uint64_t nUnknownTypeHits = 0;
+    bool recordTriggers = false;
+    std::vector<int32_t> triggerIndex;
+    std::vector<uint32_t> nEventsBefore;
+    std::vector<uint64_t> nUnknownTypeHitsBefore;
+  };
+  // isFinal: no hit is added after fHitData (false in streaming mode)
+  int32_t BuildEvents(int32_t start, int32_t stop, bool isFinal,
+                      TBuildOutput &output);
+  void ParallelBuildEvents();
+
+  // Hit streams, one per channel table index
+  uint32_t fNUnorderedStreams = 0;
 
-  std::unique_ptr<std::vector<TEventData>> fEventData;
+  std::unique_ptr<TEventBatch> fEventData;
+  TEventBatchPool *fBatchPool = nullptr;
+  std::unique_ptr<TEventBatch> NewEventBatch();
   std::string fFileName;
   std::vector<std::vector<TChSettings>> fSettings;
-  double_t fTimeWindow = 1000.0;  // ns
+  TChannelTable fChannelTable;
+  Timestamp_t fTimeWindow = 1000 * kPsPerNs;  // ps
   bool fOnlyFissionEvents = false;
+  uint32_t fNThreads = 1;
+  OverlapPolicy_t fOverlapPolicy = OverlapPolicy::DeadTime;
+
+  // Streaming mode
+  uint32_t fChunkSize = 1000000;                      // hits
+  Timestamp_t fMaxTimeDisorder = 1000000 * kPsPerNs;  // ps
+  uint32_t fReadAheadDepth = 2;                       // chunks
+  uint64_t fNLateHits = 0;
 
-  HitType_t GetHitType(uint8_t module);
+  uint64_t fNUnknownChannelHits = 0;
+  uint64_t fNUnknownTypeHits = 0;
+  void PrintUnknownHits();
 };
 
 #endif
\ No newline at end of file
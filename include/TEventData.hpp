@@ -1,8 +1,18 @@
 #ifndef TEventData_hpp
 #define TEventData_hpp 1
 
+#include <cmath>
+#include <cstdint>
 #include <tuple>
+#include <vector>
 
+// Times in the event builder and in the event files: integer ps, from the
+// raw data on.  Exact ordering and window arithmetic at any absolute time.
+typedef int64_t Timestamp_t;
+constexpr Timestamp_t kPsPerNs = 1000;
+inline Timestamp_t NsToPs(double_t ns) { return std::llround(ns * kPsPerNs); }
+
+// One hit as read from the raw data, Timestamp is FineTS (ps)
 class THitData
 {
  public:
@@ -46,7 +56,7 @@ class TEventData
   uint8_t SiMultiplicity;
   uint8_t GammaMultiplicity;
   uint8_t NeutronMultiplicity;
-  double_t TriggerTime;
+  Timestamp_t TriggerTime;  // ps
   std::vector<HitData_t> HitData;
 };
 
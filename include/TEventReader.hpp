@@ -0,0 +1,377 @@
+#ifndef TEventReader_hpp
+#define TEventReader_hpp 1
+
+#include <ROOT/RNTupleReader.hxx>
+#include <ROOT/RNTupleView.hxx>
+#include <TFile.h>
+#include <TLeaf.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Reads the events of an output file of the event builder, Event_Tree (TTree)
+// or Event_NTuple (RNTuple), into the same members for both.  For the
+// analysis macros: the members have the names of the branches.  The times are
+// given in ns: the integer ps of the files are converted, and compact hits
+// (ChannelID) are decoded into Module and Channel.
+// fields: the branches to read, all if empty.
+class TEventReader
+{
+ public:
+  TEventReader(const std::string &fileName,
+               const std::vector<std::string> &fields = {})
+      : fFields(fields)
+  {
+    fFile.reset(TFile::Open(fileName.c_str(), "READ"));
+    if (!fFile || fFile->IsZombie()) {
+      std::cerr << "File not found: " << fileName << std::endl;
+      return;
+    }
+    fTree = dynamic_cast<TTree *>(fFile->Get("Event_Tree"));
+    if (fTree) {
+      InitTree();
+    } else if (fFile->Get("Event_NTuple")) {
+      fFile.reset();
+      InitNTuple(fileName);
+    } else {
+      std::cerr << "Event_Tree or Event_NTuple not found: " << fileName
+                << std::endl;
+    }
+  };
+  ~TEventReader() {};
+  // The branch addresses point to the members
+  TEventReader(const TEventReader &) = delete;
+  TEventReader &operator=(const TEventReader &) = delete;
+
+  bool IsOpen() const { return fTree || fNTuple; }
+  bool IsNTuple() const { return fNTuple != nullptr; }
+
+  Long64_t GetEntries() const
+  {
+    if (fTree) return fTree->GetEntries();
+    if (fNTuple) return fNTuple->GetNEntries();
+    return 0;
+  }
+
+  // Entry ranges [first, last) of at least minEntries entries (but the last
+  // one), which start on TTree cluster boundaries: a range reads whole
+  // baskets.  The RNTuple ranges are of minEntries.
+  std::vector<std::pair<Long64_t, Long64_t>> GetEntryRanges(
+      Long64_t minEntries) const
+  {
+    std::vector<std::pair<Long64_t, Long64_t>> ranges;
+    const auto nEntries = GetEntries();
+    minEntries = std::max<Long64_t>(minEntries, 1);
+    Long64_t first = 0;
+    if (fTree) {
+      auto cluster = fTree->GetClusterIterator(0);
+      Long64_t start;
+      while ((start = cluster()) < nEntries) {
+        if (start - first >= minEntries) {
+          ranges.push_back({first, start});
+          first = start;
+        }
+      }
+    } else {
+      for (; first + minEntries < nEntries; first += minEntries) {
+        ranges.push_back({first, first + minEntries});
+      }
+    }
+    if (first < nEntries) ranges.push_back({first, nEntries});
+    return ranges;
+  }
+
+  void GetEntry(Long64_t entry)
+  {
+    if (fTree) {
+      if (fHasHitArrays) {
+        fNHitsBranch->GetEntry(entry);
+        if (fNHits > fMaxHits) ResizeHitArrays(fNHits);
+      }
+      fTree->GetEntry(entry);
+      if (fHasTriggerTimePs) TriggerTime = fTriggerTimePs * 1.e-3;
+      if (fHasHitArrays) CopyHitArrays();
+    } else if (fNTuple) {
+      ReadNTupleEntry(entry);
+    }
+  }
+
+  bool IsFissionEvent = false;
+  uint8_t TriggerID = 0;
+  double_t TriggerTime = 0.;
+  uint8_t SiFrontMultiplicity = 0;
+  uint8_t SiBackMultiplicity = 0;
+  uint8_t SiMultiplicity = 0;
+  uint8_t GammaMultiplicity = 0;
+  uint8_t NeutronMultiplicity = 0;
+  std::vector<uint8_t> Module;
+  std::vector<uint8_t> Channel;
+  std::vector<double_t> Timestamp;
+  std::vector<uint16_t> Energy;
+  std::vector<uint16_t> EnergyShort;
+
+ private:
+  bool IsSelected(const std::string &field) const
+  {
+    return fFields.empty() ||
+           std::find(fFields.begin(), fFields.end(), field) != fFields.end();
+  }
+
+  // TTree: the hits are written as arrays of nHits elements and the times in
+  // ps, files of older versions have vector branches and the times in ns
+  std::unique_ptr<TFile> fFile;
+  TTree *fTree = nullptr;
+  std::vector<uint8_t> *fModulePtr = &Module;
+  std::vector<uint8_t> *fChannelPtr = &Channel;
+  std::vector<double_t> *fTimestampPtr = &Timestamp;
+  std::vector<uint16_t> *fEnergyPtr = &Energy;
+  std::vector<uint16_t> *fEnergyShortPtr = &EnergyShort;
+  bool fHasTriggerTimePs = false;
+  Long64_t fTriggerTimePs = 0;
+  bool fHasHitArrays = false;
+  TBranch *fNHitsBranch = nullptr;
+  uint32_t fNHits = 0;
+  uint32_t fMaxHits = 0;  // size of the arrays
+  // Resize one array and set its branch address again
+  std::vector<std::function<void(uint32_t)>> fResizeHitArray;
+  std::vector<uint8_t> fModuleArray;
+  std::vector<uint8_t> fChannelArray;
+  std::vector<double_t> fTimestampArray;
+  std::vector<uint16_t> fEnergyArray;
+  std::vector<uint16_t> fEnergyShortArray;
+  std::vector<uint8_t> fChannelIDArray;
+  std::vector<Long64_t> fTimestampPsArray;
+  std::vector<Int_t> fTimestampPs32Array;  // compact hits
+
+  template <typename T>
+  void SetBranch(const std::string &name, T *address)
+  {
+    if (IsSelected(name)) {
+      fTree->SetBranchStatus(name.c_str(), kTRUE);
+      fTree->SetBranchAddress(name.c_str(), address);
+    }
+  }
+
+  void InitTree()
+  {
+    fTree->SetBranchStatus("*", kFALSE);
+    SetBranch("IsFissionEvent", &IsFissionEvent);
+    SetBranch("TriggerID", &TriggerID);
+    if (GetLeafType("TriggerTime") == "Long64_t") {
+      fHasTriggerTimePs = IsSelected("TriggerTime");
+      SetBranch("TriggerTime", &fTriggerTimePs);
+    } else {
+      SetBranch("TriggerTime", &TriggerTime);
+    }
+    SetBranch("SiFrontMultiplicity", &SiFrontMultiplicity);
+    SetBranch("SiBackMultiplicity", &SiBackMultiplicity);
+    SetBranch("SiMultiplicity", &SiMultiplicity);
+    SetBranch("GammaMultiplicity", &GammaMultiplicity);
+    SetBranch("NeutronMultiplicity", &NeutronMultiplicity);
+    auto nHitsLeaf = fTree->GetLeaf("nHits");
+    if (nHitsLeaf) {
+      fHasHitArrays = true;
+      // The maximum of the counter leaf is kept by TTree::Fill, but it can
+      // be smaller in merged files: GetEntry() grows the arrays when needed
+      fMaxHits = std::max<Int_t>(nHitsLeaf->GetMaximum(), 1);
+      fTree->SetBranchStatus("nHits", kTRUE);
+      fTree->SetBranchAddress("nHits", &fNHits);
+      fNHitsBranch = fTree->GetBranch("nHits");
+      if (fTree->GetBranch("ChannelID")) {
+        if (IsSelected("Module") || IsSelected("Channel")) {
+          fTree->SetBranchStatus("ChannelID", kTRUE);
+          AddHitArray("ChannelID", fChannelIDArray);
+        }
+      } else {
+        SetHitArray("Module", fModuleArray);
+        SetHitArray("Channel", fChannelArray);
+      }
+      const auto timestampType = GetLeafType("Timestamp");
+      if (timestampType == "Int_t") {
+        SetHitArray("Timestamp", fTimestampPs32Array);
+      } else if (timestampType == "Long64_t") {
+        SetHitArray("Timestamp", fTimestampPsArray);
+      } else {
+        SetHitArray("Timestamp", fTimestampArray);
+      }
+      SetHitArray("Energy", fEnergyArray);
+      SetHitArray("EnergyShort", fEnergyShortArray);
+    } else {
+      SetBranch("Module", &fModulePtr);
+      SetBranch("Channel", &fChannelPtr);
+      SetBranch("Timestamp", &fTimestampPtr);
+      SetBranch("Energy", &fEnergyPtr);
+      SetBranch("EnergyShort", &fEnergyShortPtr);
+    }
+  }
+
+  template <typename T>
+  void SetHitArray(const std::string &name, std::vector<T> &array)
+  {
+    if (IsSelected(name)) {
+      fTree->SetBranchStatus(name.c_str(), kTRUE);
+      AddHitArray(name, array);
+    }
+  }
+
+  template <typename T>
+  void AddHitArray(const std::string &name, std::vector<T> &array)
+  {
+    auto resize = [this, name, &array](uint32_t size) {
+      array.resize(size);
+      fTree->SetBranchAddress(name.c_str(), array.data());
+    };
+    resize(fMaxHits);
+    fResizeHitArray.push_back(resize);
+  }
+
+  void ResizeHitArrays(uint32_t nHits)
+  {
+    fMaxHits = std::max(nHits, 2 * fMaxHits);
+    for (auto &resize : fResizeHitArray) resize(fMaxHits);
+  }
+
+  std::string GetLeafType(const std::string &name) const
+  {
+    auto leaf = fTree->GetLeaf(name.c_str());
+    return leaf ? leaf->GetTypeName() : "";
+  }
+
+  template <typename T>
+  static void CopyHitArray(const std::vector<T> &array, uint32_t nHits,
+                           std::vector<T> &values)
+  {
+    if (!array.empty()) values.assign(array.begin(), array.begin() + nHits);
+  }
+
+  void CopyHitArrays()
+  {
+    CopyHitArray(fModuleArray, fNHits, Module);
+    CopyHitArray(fChannelArray, fNHits, Channel);
+    CopyHitArray(fTimestampArray, fNHits, Timestamp);
+    CopyHitArray(fEnergyArray, fNHits, Energy);
+    CopyHitArray(fEnergyShortArray, fNHits, EnergyShort);
+    if (!fChannelIDArray.empty()) {
+      Module.resize(fNHits);
+      Channel.resize(fNHits);
+      for (uint32_t i = 0; i < fNHits; i++) {
+        Module[i] = fChannelIDArray[i] / 16;
+        Channel[i] = fChannelIDArray[i] % 16;
+      }
+    }
+    DecodeTimestamps(fTimestampPsArray, fNHits, Timestamp);
+    DecodeTimestamps(fTimestampPs32Array, fNHits, Timestamp);
+  }
+
+  // ps -> ns
+  template <typename T>
+  static void DecodeTimestamps(const std::vector<T> &array, uint32_t nHits,
+                               std::vector<double_t> &values)
+  {
+    if (array.empty()) return;
+    values.resize(nHits);
+    for (uint32_t i = 0; i < nHits; i++) values[i] = array[i] * 1.e-3;
+  }
+
+  // RNTuple: one view per selected field.  The hits of an entry are the range
+  // of the collection view of "Hit"; the members are the subfields of its
+  // item field "_0", read with views on their full names (Hit._0.Module),
+  // which share the item index of the range.
+  typedef ROOT::Experimental::RNTupleReader NTupleReader_t;
+  template <typename T>
+  using View_t = decltype(std::declval<NTupleReader_t &>().GetView<T>(""));
+  typedef decltype(std::declval<NTupleReader_t &>().GetCollectionView(""))
+      CollectionView_t;
+  static std::string GetHitFieldName(const std::string &name)
+  {
+    return "Hit._0." + name;
+  }
+
+  std::unique_ptr<NTupleReader_t> fNTuple;
+  std::unique_ptr<CollectionView_t> fHitView;
+  std::vector<std::function<void(Long64_t)>> fReadField;
+
+  template <typename T>
+  void AddField(const std::string &name, T &value)
+  {
+    if (!IsSelected(name)) return;
+    auto view = std::make_shared<View_t<T>>(fNTuple->GetView<T>(name));
+    fReadField.push_back(
+        [view, &value](Long64_t entry) { value = (*view)(entry); });
+  }
+
+  template <typename T>
+  void AddHitField(const std::string &name, std::vector<T> &values)
+  {
+    if (!IsSelected(name)) return;
+    auto view = std::make_shared<View_t<T>>(
+        fNTuple->GetView<T>(GetHitFieldName(name)));
+    auto hitView = fHitView.get();
+    fReadField.push_back([view, hitView, &values](Long64_t entry) {
+      values.clear();
+      for (auto i : hitView->GetCollectionRange(entry)) {
+        values.push_back((*view)(i));
+      }
+    });
+  }
+
+  // Times stored in integer ps, read in ns
+  void AddTimeField(const std::string &name, double_t &value)
+  {
+    if (!IsSelected(name)) return;
+    auto view =
+        std::make_shared<View_t<int64_t>>(fNTuple->GetView<int64_t>(name));
+    fReadField.push_back(
+        [view, &value](Long64_t entry) { value = (*view)(entry) * 1.e-3; });
+  }
+
+  void AddHitTimeField(const std::string &name, std::vector<double_t> &values)
+  {
+    if (!IsSelected(name)) return;
+    auto view = std::make_shared<View_t<int64_t>>(
+        fNTuple->GetView<int64_t>(GetHitFieldName(name)));
+    auto hitView = fHitView.get();
+    fReadField.push_back([view, hitView, &values](Long64_t entry) {
+      values.clear();
+      for (auto i : hitView->GetCollectionRange(entry)) {
+        values.push_back((*view)(i) * 1.e-3);
+      }
+    });
+  }
+
+  void InitNTuple(const std::string &fileName)
+  {
+    fNTuple = NTupleReader_t::Open("Event_NTuple", fileName);
+    fHitView = std::make_unique<CollectionView_t>(
+        fNTuple->GetCollectionView("Hit"));
+    AddField("IsFissionEvent", IsFissionEvent);
+    AddField("TriggerID", TriggerID);
+    AddTimeField("TriggerTime", TriggerTime);
+    AddField("SiFrontMultiplicity", SiFrontMultiplicity);
+    AddField("SiBackMultiplicity", SiBackMultiplicity);
+    AddField("SiMultiplicity", SiMultiplicity);
+    AddField("GammaMultiplicity", GammaMultiplicity);
+    AddField("NeutronMultiplicity", NeutronMultiplicity);
+    AddHitField("Module", Module);
+    AddHitField("Channel", Channel);
+    AddHitTimeField("Timestamp", Timestamp);
+    AddHitField("Energy", Energy);
+    AddHitField("EnergyShort", EnergyShort);
+  }
+
+  void ReadNTupleEntry(Long64_t entry)
+  {
+    for (auto &read : fReadField) read(entry);
+  }
+
+  std::vector<std::string> fFields;
+};
+typedef TEventReader EventReader_t;
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef TExactSum_hpp
+#define TExactSum_hpp 1
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+// Sum of doubles without rounding.  Every value is added exactly into
+// 32-bit fixed-point limbs over the whole range of double (bit 0 is
+// 2^-1074, the smallest one), allocated at the first value: 536 bytes.
+// Integers below 2^32 (ADC, channel numbers, multiplicities) are only added
+// to an int64_t.  The sum does not depend on the order of the additions nor
+// on how they are shared out, and Get() rounds it to a double the same way
+// every time.
+class TExactSum
+{
+ public:
+  TExactSum() {};
+  TExactSum(const TExactSum &other) { *this = other; }
+  TExactSum &operator=(const TExactSum &other)
+  {
+    if (this == &other) return *this;
+    fLimb.reset();
+    if (other.fLimb) {
+      Allocate();
+      std::copy(other.fLimb.get(), other.fLimb.get() + kNLimbs, fLimb.get());
+    }
+    fInteger = other.fInteger;
+    fNAdded = other.fNAdded;
+    fSpecial = other.fSpecial;
+    return *this;
+  }
+  ~TExactSum() {};
+
+  void Add(double_t x)
+  {
+    if (std::abs(x) < kMaxInteger && x == double_t(int64_t(x))) {
+      fInteger += int64_t(x);
+    } else {
+      AddToLimbs(x);
+    }
+    if (++fNAdded >= kMaxAdded) Normalize();
+  }
+
+  void Add(const TExactSum &other)
+  {
+    fSpecial += other.fSpecial;
+    if (fNAdded + other.fNAdded >= kMaxAdded) Normalize();
+    fInteger += other.fInteger;
+    if (other.fLimb) {
+      if (!fLimb) Allocate();
+      for (int32_t i = 0; i < kNLimbs; i++) fLimb[i] += other.fLimb[i];
+    }
+    fNAdded += other.fNAdded;
+    if (fNAdded >= kMaxAdded) Normalize();
+  }
+
+  // Rounded from the lowest limb up: the limbs of a sum are unique, so is
+  // the result
+  double_t Get() const
+  {
+    if (!fLimb && fInteger == 0) return fSpecial;
+    auto sum = *this;
+    sum.Normalize();
+    double_t sign = 1.;
+    if (sum.fLimb[kNLimbs - 1] < 0) {
+      for (int32_t i = 0; i < kNLimbs; i++) sum.fLimb[i] = -sum.fLimb[i];
+      sum.Normalize();
+      sign = -1.;
+    }
+    double_t value = 0.;
+    for (int32_t i = 0; i < kNLimbs; i++) {
+      value += std::ldexp(double_t(sum.fLimb[i]), i * kLimbBits - 1074);
+    }
+    return sign * value + fSpecial;
+  }
+
+  void Clear()
+  {
+    fLimb.reset();
+    fInteger = 0;
+    fNAdded = 0;
+    fSpecial = 0.;
+  }
+
+ private:
+  static constexpr int32_t kLimbBits = 32;
+  static constexpr uint64_t kLimbMask = (uint64_t(1) << kLimbBits) - 1;
+  // Bits 0 to 2097 of the values, and room for the carries of their sum
+  static constexpr int32_t kNLimbs = 67;
+  // Each addition puts less than 2^32 into a limb or into fInteger: the
+  // carries are taken out before an int64_t could overflow
+  static constexpr uint32_t kMaxAdded = uint32_t(1) << 30;
+  static constexpr double_t kMaxInteger = 4294967296.;  // 2^32
+  // 1 is bit 1074: bit kOneBit of limb kOneLimb
+  static constexpr int32_t kOneLimb = 1074 / kLimbBits;
+  static constexpr int32_t kOneBit = 1074 % kLimbBits;
+
+  // The values other than small integers, kept out of the inlined Add()
+  void AddToLimbs(double_t x)
+  {
+    const auto bits = std::bit_cast<uint64_t>(x);
+    const int32_t biased = (bits >> 52) & 0x7FF;
+    uint64_t mantissa = bits & ((uint64_t(1) << 52) - 1);
+    if (biased == 0x7FF) {
+      fSpecial += x;  // inf and nan: same result in any order
+      return;
+    }
+    int32_t shift = 0;  // x = +-mantissa * 2^(shift - 1074)
+    if (biased > 0) {
+      mantissa |= uint64_t(1) << 52;
+      shift = biased - 1;
+    }
+    if (!fLimb) Allocate();
+
+    auto *l = fLimb.get() + shift / kLimbBits;
+    const auto offset = shift % kLimbBits;
+    const int64_t sign = (bits >> 63) ? -1 : 1;
+    const auto high = mantissa >> (kLimbBits - offset);
+    l[0] += sign * int64_t((mantissa << offset) & kLimbMask);
+    l[1] += sign * int64_t(high & kLimbMask);
+    l[2] += sign * int64_t(high >> kLimbBits);
+  }
+
+  void Allocate() { fLimb = std::make_unique<int64_t[]>(kNLimbs); }
+
+  // The integers into the limbs, every limb but the last in [0, 2^32)
+  void Normalize()
+  {
+    if (!fLimb) Allocate();
+    // fInteger = low + (fInteger >> (32 - kOneBit)) * 2^(32 - kOneBit)
+    const auto low = fInteger & ((int64_t(1) << (kLimbBits - kOneBit)) - 1);
+    fLimb[kOneLimb] += low << kOneBit;
+    fLimb[kOneLimb + 1] += fInteger >> (kLimbBits - kOneBit);
+    fInteger = 0;
+    for (int32_t i = 0; i + 1 < kNLimbs; i++) {
+      const auto carry = fLimb[i] >> kLimbBits;  // rounded down
+      fLimb[i] -= carry * (int64_t(1) << kLimbBits);
+      fLimb[i + 1] += carry;
+    }
+    fNAdded = 0;
+  }
+
+  std::unique_ptr<int64_t[]> fLimb;
+  int64_t fInteger = 0;
+  uint32_t fNAdded = 0;
+  double_t fSpecial = 0.;
+};
+typedef TExactSum ExactSum_t;
+
+#endif
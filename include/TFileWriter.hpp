@@ -1,50 +1,131 @@
 #ifndef TFileWriter_hpp
 #define TFileWriter_hpp 1
 
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleWriter.hxx>
+#include <ROOT/TBufferMerger.hxx>
 #include <TFile.h>
 #include <TTree.h>
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
 
-#include "TEventData.hpp"
+#include "TEventBatch.hpp"
+#include "THitRecord.hpp"
+#include "TMemoryBudget.hpp"
+#include "TOutputSettings.hpp"
 
+enum class OutputFormat {
+  TTree = 0,    // Event_Tree, one array branch per hit member
+  RNTuple = 1,  // Event_NTuple, one collection field "Hit"
+};
+typedef OutputFormat OutputFormat_t;
+
+// Writes the event batches in its own thread.  The batches are handed over
+// through a bounded queue: SetData() blocks while the queue is full, and the
+// writing thread sleeps until a batch comes or Write() is called.
+// With a TBufferMerger, the writers of all threads fill one Event_Tree: each
+// writer compresses its baskets in its own thread and hands a cluster of
+// about clusterSize bytes (uncompressed) to the merger at a time.
+// With a memory budget, the queued batches count in the writer stage, and
+// SetData() also waits while the budget is exhausted and batches of this
+// writer are still queued.
 class TFileWriter
 {
  public:
-  TFileWriter(std::string fileName);
+  TFileWriter(std::string fileName,
+              OutputFormat_t format = OutputFormat::TTree,
+              const TOutputSettings &settings = TOutputSettings(),
+              size_t maxQueueSize = 8);
+  // The compression is the one of the merger
+  TFileWriter(std::shared_ptr<ROOT::TBufferMerger> merger,
+              const TOutputSettings &settings = TOutputSettings(),
+              size_t clusterSize = 64 * 1024 * 1024, size_t maxQueueSize = 8);
   ~TFileWriter();
 
-  void SetData(std::unique_ptr<std::vector<TEventData>> &data);
+  // Takes the batch over (data is null afterwards).  Thread safe, waits
+  // while maxQueueSize batches are waiting to be written.
+  void SetData(std::unique_ptr<TEventBatch> &data);
+
+  // The written batches go back to the pool when given
+  void SetBatchPool(TEventBatchPool *pool) { fBatchPool = pool; }
+  void SetMemoryBudget(TMemoryBudget *budget) { fMemoryBudget = budget; }
 
+  // Writes the batches still in the queue and closes the file
   void Write();
 
+  // Compact hits more than +-2.1 ms from the trigger, written as the int32
+  // limit (long chains of merged triggers)
+  uint64_t GetNSaturatedHits() const { return fNSaturatedHits; }
+
  private:
   void WriteData();
+  void InitTree();
+  // Returns the number of bytes filled (uncompressed)
+  size_t FillTree(TEventBatch &batch);
+  // Fills the compact hit columns of the whole batch
+  void EncodeCompactHits(const THitBuffer &hit);
+  void InitNTuple(const std::string &fileName);
+  void FillNTuple(const TEventBatch &batch);
   std::thread fWriteDataThread;
   std::mutex fMutex;
-  bool fWritingFlag;
+  std::condition_variable fNotEmpty;
+  std::condition_variable fNotFull;
+  bool fClosed = false;
+
+  std::deque<std::unique_ptr<TEventBatch>> fRawData;
+  std::deque<TMemoryReservation> fRawDataReservations;  // one per fRawData
+  size_t fMaxQueueSize;
+  TEventBatchPool *fBatchPool = nullptr;
+  TMemoryBudget *fMemoryBudget = nullptr;
+  TOutputSettings fSettings;
+  TFile *fOutputFile = nullptr;
+  TTree *fTree = nullptr;
+
+  // RNTuple output, the fields are bound to the default entry
+  std::unique_ptr<ROOT::Experimental::RNTupleWriter> fNTupleWriter;
+  std::shared_ptr<bool> fNIsFissionEvent;
+  std::shared_ptr<uint8_t> fNTriggerID;
+  std::shared_ptr<int64_t> fNTriggerTime;
+  std::shared_ptr<uint8_t> fNSiFrontMultiplicity;
+  std::shared_ptr<uint8_t> fNSiBackMultiplicity;
+  std::shared_ptr<uint8_t> fNSiMultiplicity;
+  std::shared_ptr<uint8_t> fNGammaMultiplicity;
+  std::shared_ptr<uint8_t> fNNeutronMultiplicity;
+  std::shared_ptr<std::vector<THitRecord>> fNHit;
 
-  std::unique_ptr<std::vector<TEventData>> fRawData;
-  TFile *fOutputFile;
-  TTree *fTree;
+  // Single output file mode
+  std::shared_ptr<ROOT::TBufferMerger> fMerger;
+  std::shared_ptr<ROOT::TBufferMergerFile> fMergerFile;
+  size_t fClusterSize = 0;
+  size_t fClusterFilled = 0;
 
   // For tree branches
   bool fIsFissionEvent;
   uint8_t fTriggerID;
-  double_t fTriggerTime;
+  Timestamp_t fTriggerTime;
   uint8_t fSiFrontMultiplicity;
   uint8_t fSiBackMultiplicity;
   uint8_t fSiMultiplicity;
   uint8_t fGammaMultiplicity;
   uint8_t fNeutronMultiplicity;
-  std::vector<uint8_t> fModule;
-  std::vector<uint8_t> fChannel;
-  std::vector<double_t> fTimestamp;
-  std::vector<uint16_t> fEnergy;
-  std::vector<uint16_t> fEnergyShort;
+  // The hit branches are arrays of nHits elements, read in place from the
+  // columns of the batch
+  uint32_t fNHits;
+  TBranch *fModuleBranch;
+  TBranch *fChannelBranch;
+  TBranch *fTimestampBranch;
+  TBranch *fEnergyBranch;
+  TBranch *fEnergyShortBranch;
+  // Compact hits: ChannelID and Timestamp (ps) of the current batch
+  TBranch *fChannelIDBranch;
+  std::vector<uint8_t> fChannelID;
+  std::vector<int32_t> fTimestampPs;
+  uint64_t fNSaturatedHits = 0;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef THistStats_hpp
+#define THistStats_hpp 1
+
+#include <TH1.h>
+
+#include <cmath>
+#include <cstdint>
+
+#include "TExactSum.hpp"
+
+// Sums of the filled values kept by TH1::Fill for the mean, RMS and
+// covariance, unit weights.  A histogram made from counts only has them
+// from the bin centres (ResetStats()); the workers of TLocalHist and
+// TCompactHist2D keep these sums of the values in the axis range, as ROOT
+// does.  The sums are exact (TExactSum): the statistics are the same bit
+// for bit however the values are shared out to the workers.
+class THistStats
+{
+ public:
+  void Add(double_t x)
+  {
+    fN++;
+    fSumX.Add(x);
+    fSumX2.Add(x * x);
+  }
+  void Add(double_t x, double_t y)
+  {
+    Add(x);
+    fSumY.Add(y);
+    fSumY2.Add(y * y);
+    fSumXY.Add(x * y);
+  }
+  void Add(const THistStats &other)
+  {
+    fN += other.fN;
+    fSumX.Add(other.fSumX);
+    fSumX2.Add(other.fSumX2);
+    fSumY.Add(other.fSumY);
+    fSumY2.Add(other.fSumY2);
+    fSumXY.Add(other.fSumXY);
+  }
+  void Clear() { *this = THistStats(); }
+
+  // Into the array of TH1::GetStats() and TH1::PutStats()
+  void AddTo(double_t *stats) const
+  {
+    stats[0] += fN;  // sum of w
+    stats[1] += fN;  // sum of w^2
+    stats[2] += fSumX.Get();
+    stats[3] += fSumX2.Get();
+    stats[4] += fSumY.Get();
+    stats[5] += fSumY2.Get();
+    stats[6] += fSumXY.Get();
+  }
+
+  // Only the values in the range count, as in TH1::Fill
+  static bool IsInRange(int32_t bin, int32_t nBins)
+  {
+    return bin >= 1 && bin <= nBins;
+  }
+
+ private:
+  uint64_t fN = 0;
+  TExactSum fSumX;
+  TExactSum fSumX2;
+  TExactSum fSumY;
+  TExactSum fSumY2;
+  TExactSum fSumXY;
+};
+typedef THistStats HistStats_t;
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef THitBuffer_hpp
+#define THitBuffer_hpp 1
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "TEventData.hpp"
+
+// Column-wise (structure of arrays) hit store.  The time window scans only
+// read the Timestamp column; the other columns are touched for the hits
+// which go into an event.  14 bytes per hit instead of 32 for THitData.
+// Timestamps are integer ps (Timestamp_t).
+class THitBuffer
+{
+ public:
+  THitBuffer() {};
+  ~THitBuffer() {};
+
+  std::vector<Timestamp_t> Timestamp;
+  std::vector<uint8_t> Module;
+  std::vector<uint8_t> Channel;
+  std::vector<uint16_t> Energy;
+  std::vector<uint16_t> EnergyShort;
+
+  static constexpr size_t kBytesPerHit = sizeof(Timestamp_t) +
+                                         2 * sizeof(uint8_t) +
+                                         2 * sizeof(uint16_t);
+
+  size_t Size() const { return Timestamp.size(); }
+
+  void Clear()
+  {
+    Timestamp.clear();
+    Module.clear();
+    Channel.clear();
+    Energy.clear();
+    EnergyShort.clear();
+  }
+
+  void Reserve(size_t n)
+  {
+    Timestamp.reserve(n);
+    Module.reserve(n);
+    Channel.reserve(n);
+    Energy.reserve(n);
+    EnergyShort.reserve(n);
+  }
+
+  // Keep the first n hits
+  void Resize(size_t n)
+  {
+    Timestamp.resize(n);
+    Module.resize(n);
+    Channel.resize(n);
+    Energy.resize(n);
+    EnergyShort.resize(n);
+  }
+
+  // Release the memory, not only the content
+  void ShrinkToFit()
+  {
+    Timestamp.shrink_to_fit();
+    Module.shrink_to_fit();
+    Channel.shrink_to_fit();
+    Energy.shrink_to_fit();
+    EnergyShort.shrink_to_fit();
+  }
+
+  // hit.Timestamp (ps) is rounded to the integer ps
+  void PushBack(const THitData &hit)
+  {
+    PushBack(hit, std::llround(hit.Timestamp));
+  }
+
+  void PushBack(const THitData &hit, Timestamp_t timestamp)
+  {
+    Timestamp.push_back(timestamp);
+    Module.push_back(hit.Module);
+    Channel.push_back(hit.Channel);
+    Energy.push_back(hit.Energy);
+    EnergyShort.push_back(hit.EnergyShort);
+  }
+
+  // Copy of the hit i of src at the end
+  void PushBack(const THitBuffer &src, size_t i)
+  {
+    Timestamp.push_back(src.Timestamp[i]);
+    Module.push_back(src.Module[i]);
+    Channel.push_back(src.Channel[i]);
+    Energy.push_back(src.Energy[i]);
+    EnergyShort.push_back(src.EnergyShort[i]);
+  }
+
+  // Copy of the hits [begin, end) of src at the end
+  void Append(const THitBuffer &src, size_t begin, size_t end)
+  {
+    Timestamp.insert(Timestamp.end(), src.Timestamp.begin() + begin,
+                     src.Timestamp.begin() + end);
+    Module.insert(Module.end(), src.Module.begin() + begin,
+                  src.Module.begin() + end);
+    Channel.insert(Channel.end(), src.Channel.begin() + begin,
+                   src.Channel.begin() + end);
+    Energy.insert(Energy.end(), src.Energy.begin() + begin,
+                  src.Energy.begin() + end);
+    EnergyShort.insert(EnergyShort.end(), src.EnergyShort.begin() + begin,
+                       src.EnergyShort.begin() + end);
+  }
+
+  THitData GetHit(size_t i) const
+  {
+    return THitData(Module[i], Channel[i], Timestamp[i], Energy[i],
+                    EnergyShort[i]);
+  }
+
+  // Remove the first n hits
+  void EraseFront(size_t n)
+  {
+    Timestamp.erase(Timestamp.begin(), Timestamp.begin() + n);
+    Module.erase(Module.begin(), Module.begin() + n);
+    Channel.erase(Channel.begin(), Channel.begin() + n);
+    Energy.erase(Energy.begin(), Energy.begin() + n);
+    EnergyShort.erase(EnergyShort.begin(), EnergyShort.begin() + n);
+  }
+
+  // this = src reordered by index (this[i] = src[index[i]])
+  void Gather(const THitBuffer &src, const std::vector<uint32_t> &index)
+  {
+    const auto n = index.size();
+    Timestamp.resize(n);
+    Module.resize(n);
+    Channel.resize(n);
+    Energy.resize(n);
+    EnergyShort.resize(n);
+    for (size_t i = 0; i < n; i++) Timestamp[i] = src.Timestamp[index[i]];
+    for (size_t i = 0; i < n; i++) Module[i] = src.Module[index[i]];
+    for (size_t i = 0; i < n; i++) Channel[i] = src.Channel[index[i]];
+    for (size_t i = 0; i < n; i++) Energy[i] = src.Energy[index[i]];
+    for (size_t i = 0; i < n; i++) EnergyShort[i] = src.EnergyShort[index[i]];
+  }
+
+  void Swap(THitBuffer &other)
+  {
+    Timestamp.swap(other.Timestamp);
+    Module.swap(other.Module);
+    Channel.swap(other.Channel);
+    Energy.swap(other.Energy);
+    EnergyShort.swap(other.EnergyShort);
+  }
+
+  size_t GetMemorySize() const
+  {
+    return Timestamp.capacity() * sizeof(Timestamp_t) +
+           Module.capacity() * sizeof(uint8_t) +
+           Channel.capacity() * sizeof(uint8_t) +
+           Energy.capacity() * sizeof(uint16_t) +
+           EnergyShort.capacity() * sizeof(uint16_t);
+  }
+};
+typedef THitBuffer HitBuffer_t;
+
+#endif
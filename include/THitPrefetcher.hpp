@@ -0,0 +1,67 @@
+#ifndef THitPrefetcher_hpp
+#define THitPrefetcher_hpp 1
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "TEventBuilder.hpp"
+
+// Loads the hits of the files to be built next in background threads, while
+// the current file is built (double buffering for one file ahead).  The load
+// time which is hidden behind the event building gives the overlap ratio:
+// close to 1 the run is CPU-bound, close to 0 I/O-bound.  Under a memory
+// budget, a file is prefetched only if its hits fit; a file which has to wait
+// for memory first drops the files loaded in advance (loaded again later),
+// so that they do not hold the memory the current files wait for.
+// Thread safe.
+class THitPrefetcher
+{
+ public:
+  // Makes the event builder of a file (LoadHits() not called yet)
+  typedef std::function<std::unique_ptr<TEventBuilder>(uint32_t file)>
+      Factory_t;
+
+  THitPrefetcher(const Factory_t &factory);
+  ~THitPrefetcher();
+
+  // Starts LoadHits() of the file in a background thread, if not yet done
+  void Prefetch(uint32_t file);
+
+  // Event builder of the file with the hits loaded.  Waits for the prefetch,
+  // or loads the hits now if the file was not prefetched.
+  std::unique_ptr<TEventBuilder> Get(uint32_t file, uint32_t &nHits);
+
+  // In s, summed over the files
+  double_t GetLoadTime() const { return fLoadTime; }
+  double_t GetWaitTime() const { return fWaitTime; }
+  // Fraction of the load time hidden behind the event building
+  double_t GetOverlapRatio() const
+  {
+    return (fLoadTime > 0.) ? 1. - fWaitTime / fLoadTime : 0.;
+  }
+  void PrintStats() const;
+
+ private:
+  class TPendingLoad
+  {
+   public:
+    std::unique_ptr<TEventBuilder> builder;
+    std::future<uint32_t> nHits;
+  };
+
+  uint32_t Load(TEventBuilder *builder, bool waitForMemory);
+  void DropPending();
+
+  Factory_t fFactory;
+  std::mutex fMutex;
+  std::map<uint32_t, TPendingLoad> fPending;
+  double_t fLoadTime = 0.;
+  double_t fWaitTime = 0.;
+  uint32_t fNDropped = 0;
+};
+
+#endif
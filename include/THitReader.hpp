@@ -0,0 +1,85 @@
+#ifndef THitReader_hpp
+#define THitReader_hpp 1
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TChSettings.hpp"
+#include "TChannelTable.hpp"
+#include "TEventData.hpp"
+#include "THitBuffer.hpp"
+#include "TMemoryBudget.hpp"
+
+// Reads the ELIADE_Tree of one or more raw data files as one continuous hit
+// stream.  The files are decoded in a separate thread, up to readAheadDepth
+// chunks ahead of the consumer.  Timestamps are rounded to integer ps and the
+// time offsets are applied.  Hits of channels not in the channel settings are
+// dropped and counted.  With a memory budget, every chunk is reserved until
+// the consumer gives it back; a chunk which does not fit is made smaller
+// (down to kMinChunkSize hits) before the reader waits for memory.
+class THitReader
+{
+ public:
+  THitReader(const std::vector<std::string> &fileList,
+             const std::vector<std::vector<TChSettings>> &settings,
+             uint32_t chunkSize = 1000000, uint32_t readAheadDepth = 2);
+  ~THitReader();
+
+  // Before Start()
+  void SetMemoryBudget(TMemoryBudget *budget) { fMemoryBudget = budget; }
+  void Start();
+
+  // Blocks until the next chunk is decoded.  Returns false at the end of the
+  // stream.  The previous content of chunk is recycled for later reads.
+  bool GetChunk(THitBuffer &chunk);
+
+  uint64_t GetNHits() const { return fNHits; }
+  uint64_t GetNUnknownChannelHits() const { return fNUnknownChannelHits; }
+  uint64_t GetNShrunkChunks() const { return fNShrunkChunks; }
+
+  static constexpr uint32_t kMinChunkSize = 10000;  // hits
+
+  // The raw tree is opened with a TTreeCache on the hit branches
+  static constexpr Long64_t kTreeCacheSize = 64 * 1024 * 1024;  // bytes
+  static TTree *OpenHitTree(const std::string &fileName, TFile *&file,
+                            HitData_t &hit);
+  // Number of hits in the file, 0 if it cannot be read
+  static Long64_t GetNEntries(const std::string &fileName);
+  static bool CheckTimeRange(const std::string &fileName, Timestamp_t firstTS,
+                             Timestamp_t lastTS);
+
+ private:
+  void ReadFiles();
+  void ReadFile(const std::string &fileName);
+  bool PushChunk(THitBuffer &chunk, TMemoryReservation &reservation);
+  // Returns the size of the next chunk
+  uint32_t ReserveChunk(TMemoryReservation &reservation);
+
+  std::vector<std::string> fFileList;
+  TChannelTable fChannelTable;
+  uint32_t fChunkSize;
+  uint32_t fReadAheadDepth;
+  uint64_t fNHits = 0;
+  uint64_t fNUnknownChannelHits = 0;
+  uint64_t fNShrunkChunks = 0;
+
+  TMemoryBudget *fMemoryBudget = nullptr;
+  std::deque<TMemoryReservation> fChunkReservations;  // one per fChunks
+  TMemoryReservation fConsumerReservation;  // of the chunk being consumed
+  std::thread fReadThread;
+  std::mutex fMutex;
+  std::condition_variable fCondition;
+  std::deque<THitBuffer> fChunks;
+  std::vector<THitBuffer> fFreeChunks;
+  bool fFinished = false;
+  bool fStop = false;
+};
+
+#endif
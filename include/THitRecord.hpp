@@ -0,0 +1,20 @@
+#ifndef THitRecord_hpp
+#define THitRecord_hpp 1
+
+#include <cmath>
+#include <cstdint>
+
+// One hit of an event in the RNTuple output (collection field "Hit").
+// Plain struct, no virtual table: RNTuple stores each member as a column.
+class THitRecord
+{
+ public:
+  uint8_t Module = 0;
+  uint8_t Channel = 0;
+  int64_t Timestamp = 0;  // ps, relative to TriggerTime
+  uint16_t Energy = 0;
+  uint16_t EnergyShort = 0;
+};
+typedef THitRecord HitRecord_t;
+
+#endif
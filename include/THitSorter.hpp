@@ -0,0 +1,77 @@
+#ifndef THitSorter_hpp
+#define THitSorter_hpp 1
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "TEventData.hpp"
+#include "THitBuffer.hpp"
+#include "TWorkStealingPool.hpp"
+
+enum class SortPath {
+  Sorted = 0,     // already in time order, only checked
+  Insertion = 1,  // locally disordered, insertion sort
+  Radix = 2,      // LSD radix sort
+};
+typedef SortPath SortPath_t;
+
+// Stable sort of hit indices by their integer timestamp.  LSD radix sort on
+// the timestamps relative to the smallest one, 8 bits per pass: the passes of
+// the bytes equal for all hits are skipped, a file of a few minutes takes 6
+// passes.  Sorted input and locally disordered input (every hit a few places
+// away from its own) are found first and cost O(N).  From kMinParallelHits
+// on, the key gathering and the histograms and scatters of the passes run on
+// one block of the input per thread.
+class THitSorter
+{
+ public:
+  THitSorter(uint32_t nThreads = 1);
+  ~THitSorter();
+
+  static constexpr size_t kMinParallelHits = 1 << 20;
+
+  void SetNThreads(uint32_t nThreads);
+
+  // Sorts [first, last) by timestamp[index].  Equal timestamps keep their
+  // order.
+  void Sort(const std::vector<Timestamp_t> &timestamp, uint32_t *first,
+            uint32_t *last);
+  void Sort(const std::vector<Timestamp_t> &timestamp,
+            std::vector<uint32_t> &index)
+  {
+    Sort(timestamp, index.data(), index.data() + index.size());
+  }
+  // Sorts the hits, buffer is used for the reordering
+  void Sort(THitBuffer &hits, THitBuffer &buffer);
+
+  // Of the last Sort()
+  SortPath_t GetLastPath() const { return fLastPath; }
+  uint32_t GetNPasses() const { return fNPasses; }
+
+  // Release the memory of the work arrays
+  void ShrinkToFit();
+
+ private:
+  // Runs f(begin, end) on nBlocks blocks of [0, n)
+  template <typename F>
+  void ForBlocks(size_t n, uint32_t nBlocks, const F &f);
+  bool InsertionSort(size_t n);
+  void RadixSort(size_t n, uint32_t nBlocks, uint64_t range);
+
+  uint32_t fNThreads = 1;
+  std::unique_ptr<TWorkStealingPool> fPool;
+
+  // Keys relative to the smallest timestamp, and indices, with their buffers
+  // for the passes
+  std::vector<uint64_t> fKey;
+  std::vector<uint64_t> fKeyBuffer;
+  std::vector<uint32_t> fIndex;
+  std::vector<uint32_t> fIndexBuffer;
+
+  SortPath_t fLastPath = SortPath::Sorted;
+  uint32_t fNPasses = 0;
+};
+typedef THitSorter HitSorter_t;
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef TLocalHist_hpp
+#define TLocalHist_hpp 1
+
+#include <TAxis.h>
+#include <TH1.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "TBlockCounts.hpp"
+#include "THistStats.hpp"
+
+// Histogram filled by several worker threads without locks.  Every worker
+// counts into its own sparse integer bins (TBlockCounts) and keeps the sums
+// of the filled values (THistStats); Merge() adds those of all workers into
+// the ROOT histogram.  The counts are integers and the sums are exact, so
+// the bin contents, the entries and the statistics (mean, RMS, covariance
+// of the filled values, as with TH1::Fill) are the same bit for bit for any
+// number of workers.  Unit weights only.  The ROOT histogram must not be
+// filled directly while workers fill this one.
+template <typename H>
+class TLocalHist
+{
+ public:
+  TLocalHist(H *hist, uint32_t nWorkers)
+      : fHist(hist),
+        fXAxis(hist->GetXaxis()),
+        fYAxis(hist->GetYaxis()),
+        fNCellsX(hist->GetNbinsX() + 2),
+        fNBinsX(hist->GetNbinsX()),
+        fNBinsY(hist->GetNbinsY()),
+        fWorker(nWorkers)
+  {
+    for (auto &worker : fWorker) worker.counts.Resize(hist->GetNcells());
+    hist->GetStats(fInitialStats);
+  };
+  ~TLocalHist() {};
+
+  H *Get() const { return fHist; }
+
+  void Fill(uint32_t worker, double_t x)
+  {
+    FillBin(worker, fXAxis->FindFixBin(x), x);
+  }
+  void Fill(uint32_t worker, double_t x, double_t y)
+  {
+    const auto binX = fXAxis->FindFixBin(x);
+    const auto binY = fYAxis->FindFixBin(y);
+    auto &local = fWorker[worker];
+    local.counts.Add(binX + fNCellsX * binY);
+    if (THistStats::IsInRange(binX, fNBinsX) &&
+        THistStats::IsInRange(binY, fNBinsY)) {
+      local.stats.Add(x, y);
+    }
+  }
+  // Bin of x already known, e.g. from a TCalibrationTable (1D)
+  void FillBin(uint32_t worker, int32_t bin, double_t x)
+  {
+    auto &local = fWorker[worker];
+    local.counts.Add(bin);
+    if (THistStats::IsInRange(bin, fNBinsX)) local.stats.Add(x);
+  }
+
+  // Adds the counts of the workers to the histogram and clears them
+  void Merge()
+  {
+    TBlockCounts sum(fHist->GetNcells());
+    for (auto &worker : fWorker) {
+      sum.Add(worker.counts);
+      fTotalStats.Add(worker.stats);
+      worker.counts.Clear();
+      worker.stats.Clear();
+    }
+    if (sum.GetEntries() == 0) return;
+    // Rounded once from all the values filled so far
+    double_t stats[TH1::kNstat];
+    std::copy(fInitialStats, fInitialStats + TH1::kNstat, stats);
+    fTotalStats.AddTo(stats);
+    const auto oldEntries = fHist->GetEntries();
+    sum.ForEach([this](size_t bin, uint64_t count) {
+      fHist->SetBinContent(bin, fHist->GetBinContent(bin) + count);
+    });
+    fHist->PutStats(stats);
+    fHist->SetEntries(oldEntries + sum.GetEntries());
+  }
+
+ private:
+  H *fHist;
+  const TAxis *fXAxis;
+  const TAxis *fYAxis;
+  int32_t fNCellsX;
+  int32_t fNBinsX;
+  int32_t fNBinsY;
+  double_t fInitialStats[TH1::kNstat] = {};  // of the histogram given
+  THistStats fTotalStats;
+  // Own cache line per worker: no false sharing of the entry counters
+  class alignas(64) TWorkerCounts
+  {
+   public:
+    TBlockCounts counts;
+    THistStats stats;
+  };
+  std::vector<TWorkerCounts> fWorker;
+};
+
+#endif
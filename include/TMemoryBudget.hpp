@@ -0,0 +1,103 @@
+#ifndef TMemoryBudget_hpp
+#define TMemoryBudget_hpp 1
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+enum class MemoryStage : uint8_t {
+  Loader = 0,   // hits loaded or read in chunks
+  Builder = 1,  // events built, not yet handed to a writer
+  Writer = 2,   // events waiting in the writer queues
+};
+typedef MemoryStage MemoryStage_t;
+
+class TMemoryBudget;
+
+// Bytes of one stage counted in a memory budget, given back when released or
+// destroyed.  Move only.
+class TMemoryReservation
+{
+ public:
+  TMemoryReservation() {};
+  TMemoryReservation(TMemoryBudget *budget, MemoryStage_t stage,
+                     size_t bytes)
+      : fBudget(budget), fStage(stage), fBytes(bytes) {};
+  ~TMemoryReservation() { Release(); }
+
+  TMemoryReservation(const TMemoryReservation &) = delete;
+  TMemoryReservation &operator=(const TMemoryReservation &) = delete;
+  TMemoryReservation(TMemoryReservation &&other) { *this = std::move(other); }
+  TMemoryReservation &operator=(TMemoryReservation &&other);
+
+  bool IsValid() const { return fBudget != nullptr; }
+  size_t GetBytes() const { return fBytes; }
+
+  // Counts bytes instead, without waiting (the memory is already allocated)
+  void Resize(size_t bytes);
+  void Release();
+
+ private:
+  TMemoryBudget *fBudget = nullptr;
+  MemoryStage_t fStage = MemoryStage::Loader;
+  size_t fBytes = 0;
+};
+typedef TMemoryReservation MemoryReservation_t;
+
+// Central memory accountant of a run.  The loaders, builders and writer
+// queues reserve the memory of the hits and events they hold; a stage which
+// does not fit in the limit waits for the others to give memory back, or
+// does less at a time (smaller chunks, no read ahead).  One request larger
+// than the whole limit goes through when nothing else is reserved.
+// limit 0: no limit, the usage is only counted.  Thread safe.
+class TMemoryBudget
+{
+ public:
+  static constexpr uint32_t kNStages = 3;
+
+  TMemoryBudget(size_t limit = 0) : fLimit(limit) {};
+  ~TMemoryBudget() {};
+
+  // Waits until bytes fit in the limit
+  TMemoryReservation Reserve(MemoryStage_t stage, size_t bytes);
+  // Invalid reservation if bytes do not fit now, or if a Reserve() waits
+  TMemoryReservation TryReserve(MemoryStage_t stage, size_t bytes);
+  // Counts bytes already allocated, without waiting
+  TMemoryReservation Charge(MemoryStage_t stage, size_t bytes);
+
+  bool HasRoom(size_t bytes);
+
+  size_t GetLimit() const { return fLimit; }
+  size_t GetUsage();
+  size_t GetPeak() const { return fPeak; }
+  size_t GetPeak(MemoryStage_t stage) const
+  {
+    return fStagePeak[static_cast<uint32_t>(stage)];
+  }
+  uint64_t GetNWaits() const { return fNWaits; }
+  void PrintStats() const;
+
+ private:
+  friend class TMemoryReservation;
+  bool Fits(size_t bytes) const
+  {
+    return fLimit == 0 || fUsage + bytes <= fLimit || fUsage == 0;
+  }
+  void Add(MemoryStage_t stage, size_t bytes);
+  void Remove(MemoryStage_t stage, size_t bytes);
+
+  std::mutex fMutex;
+  std::condition_variable fReleased;
+  size_t fLimit;
+  size_t fUsage = 0;
+  size_t fPeak = 0;
+  std::array<size_t, kNStages> fStageUsage{};
+  std::array<size_t, kNStages> fStagePeak{};
+  uint32_t fNWaiting = 0;
+  uint64_t fNWaits = 0;
+};
+typedef TMemoryBudget MemoryBudget_t;
+
+#endif
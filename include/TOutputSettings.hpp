@@ -0,0 +1,50 @@
+#ifndef TOutputSettings_hpp
+#define TOutputSettings_hpp 1
+
+#include <Compression.h>
+
+#include <cstdint>
+#include <string>
+
+// How the event files are written: schema of the hits, compression and basket
+// size of the branches.
+// Compact hits (TTree only): ChannelID[nHits] = module * 16 + channel in one
+// uint8_t, and Timestamp[nHits] relative to the trigger in int32 ps (+-2.1 ms)
+// instead of int64 ps.
+class TOutputSettings
+{
+ public:
+  TOutputSettings() {};
+  ~TOutputSettings() {};
+
+  static constexpr int32_t kDefaultCompression = -1;
+  static constexpr int32_t kUnknownCompression = -2;
+  // ChannelID of the compact hits fits in one uint8_t
+  static constexpr uint32_t kMaxCompactModules = 16;
+
+  bool compactHits = false;
+  // ROOT compression setting, algorithm * 100 + level, -1: ROOT default
+  int32_t compression = kDefaultCompression;
+  int32_t basketSize = 0;  // bytes, 0: ROOT default
+
+  // algorithm: Default, ZLIB, LZMA, LZ4 or ZSTD
+  static int32_t GetCompression(const std::string &algorithm, int32_t level)
+  {
+    using Algorithm_t = ROOT::RCompressionSetting::EAlgorithm;
+    if (algorithm == "Default") {
+      return kDefaultCompression;
+    } else if (algorithm == "ZLIB") {
+      return ROOT::CompressionSettings(Algorithm_t::kZLIB, level);
+    } else if (algorithm == "LZMA") {
+      return ROOT::CompressionSettings(Algorithm_t::kLZMA, level);
+    } else if (algorithm == "LZ4") {
+      return ROOT::CompressionSettings(Algorithm_t::kLZ4, level);
+    } else if (algorithm == "ZSTD") {
+      return ROOT::CompressionSettings(Algorithm_t::kZSTD, level);
+    }
+    return kUnknownCompression;
+  }
+};
+typedef TOutputSettings OutputSettings_t;
+
+#endif
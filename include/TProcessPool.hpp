@@ -0,0 +1,48 @@
+#ifndef TProcessPool_hpp
+#define TProcessPool_hpp 1
+
+#include <sys/types.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Forks nProcesses worker processes, each with its own ROOT and its own
+// global locks, which would serialize the TFile and TTree work of threads in
+// one process.  The workers send progress messages (text lines) to the
+// coordinator through one pipe each.  Fork before any thread is started.
+class TProcessPool
+{
+ public:
+  static constexpr uint32_t kCoordinator = ~0u;
+
+  TProcessPool(uint32_t nProcesses);
+  ~TProcessPool();
+
+  // Returns the index of the worker (0 ... nProcesses - 1) in the worker
+  // processes, kCoordinator in the coordinator
+  uint32_t Fork();
+  bool IsWorker() const { return fWorker != kCoordinator; }
+  uint32_t GetWorker() const { return fWorker; }
+  uint32_t GetNProcesses() const { return fNProcesses; }
+
+  // Worker: sends one line (without '\n') to the coordinator
+  void Report(const std::string &message);
+
+  // Coordinator: calls onMessage(worker, line) for the lines of the workers
+  // until all have exited.  Returns the number of workers which failed
+  // (exit code not 0 or killed).
+  typedef std::function<void(uint32_t worker, const std::string &message)>
+      MessageHandler_t;
+  uint32_t Wait(const MessageHandler_t &onMessage);
+
+ private:
+  uint32_t fNProcesses;
+  uint32_t fWorker = kCoordinator;
+  std::vector<pid_t> fPid;
+  std::vector<int> fReadFd;  // coordinator ends of the pipes
+  int fWriteFd = -1;         // worker end of its pipe
+};
+typedef TProcessPool ProcessPool_t;
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef TTimeAligner_hpp
+#define TTimeAligner_hpp 1
+
+#include <TH1.h>
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TBlockCounts.hpp"
+#include "TChSettings.hpp"
+#include "TChannelTable.hpp"
+#include "THitBuffer.hpp"
+
+// Time alignment in the event builder (--align): every hit of the reference
+// channel is a trigger, the times of the other hits in its +-window are
+// counted per channel straight from the sorted hits of the builders, no
+// event is built or written.  Align() fits the peaks as time_alignment.cpp
+// does and gives the new time offsets.  The offsets the hits were loaded
+// with are taken into account: a run with aligned offsets gives the same
+// offsets again, no need of gen_no_timeoffset.cpp first.
+class TTimeAligner
+{
+ public:
+  TTimeAligner(const std::vector<std::vector<TChSettings>> &settings,
+               uint32_t refModule, uint32_t refChannel, double_t timeWindow,
+               uint32_t nWorkers);
+  ~TTimeAligner() {};
+
+  // Hits of the channels other than Si are counted only when the ADC of the
+  // trigger is in [min, max] (e.g. a 60Co line)
+  void SetTriggerADCRange(uint16_t min, uint16_t max)
+  {
+    fTriggerADCMin = min;
+    fTriggerADCMax = max;
+  }
+
+  // The loaded hits of one file: sorted, time offsets applied
+  void Fill(const THitBuffer &hits, uint32_t worker);
+
+  // Fits the time of each channel and writes the new time offsets into the
+  // settings.  Returns the number of channels aligned; the others keep
+  // their offset relative to the reference.
+  uint32_t Align(std::vector<std::vector<TChSettings>> &settings);
+
+  // The histograms and fits of Align(), to check them
+  void Write(const std::string &fileName) const;
+
+  // Only TimeOffset is changed in the file
+  static bool WriteTimeOffsets(
+      const std::string &fileName,
+      const std::vector<std::vector<TChSettings>> &settings);
+
+  static constexpr Timestamp_t kBinWidth = 100;  // ps
+  static constexpr double_t kLightSpeed = 29.9792458;  // cm/ns
+
+ private:
+  // Gaussian around the highest bin, fitted twice.  False without entries.
+  static bool FitPeak(TH1D *hist, double_t sigma);
+
+  TChannelTable fChannelTable;
+  uint32_t fRefIndex;
+  Timestamp_t fTimeWindow;  // ps
+  uint32_t fNBins;
+  uint16_t fTriggerADCMin = 0;
+  uint16_t fTriggerADCMax = 0xFFFF;
+
+  // bin: channel table index * fNBins + time bin.  Own cache line per worker.
+  class alignas(64) TWorkerCounts
+  {
+   public:
+    TBlockCounts counts;
+  };
+  std::vector<TWorkerCounts> fWorker;
+  std::vector<std::unique_ptr<TH1D>> fHists;
+};
+typedef TTimeAligner TimeAligner_t;
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef TWorkStealingPool_hpp
+#define TWorkStealingPool_hpp 1
+
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Runs a set of independent tasks on nThreads threads.  The tasks are dealt
+// round robin to one queue per thread; a thread takes its own tasks from the
+// front and, when its queue is empty, steals from the back of the others.
+// Given largest first, the big tasks start first and the small ones fill the
+// tail.
+class TWorkStealingPool
+{
+ public:
+  TWorkStealingPool(uint32_t nThreads);
+  ~TWorkStealingPool();
+
+  // worker: 0 ... nThreads - 1, the thread running the task
+  typedef std::function<void(uint32_t task, uint32_t worker)> Task_t;
+
+  // Runs task(0) ... task(nTasks - 1) and returns when all are done
+  void Run(uint32_t nTasks, const Task_t &task);
+
+  // The next (up to depth) tasks of the worker, for read ahead.  They are
+  // kept for the worker: the other workers do not steal them.
+  std::vector<uint32_t> PeekTasks(uint32_t worker, uint32_t depth);
+
+  uint32_t GetNThreads() const { return fNThreads; }
+  uint64_t GetNSteals() const { return fNSteals; }
+
+  // Of the last Run(), in s
+  double_t GetRunTime() const { return fRunTime; }
+  double_t GetBusyTime(uint32_t worker) const { return fBusyTime[worker]; }
+  double_t GetIdleTime(uint32_t worker) const
+  {
+    return fRunTime - fBusyTime[worker];
+  }
+  uint32_t GetNTasks(uint32_t worker) const { return fNTasks[worker]; }
+  void PrintStats() const;
+
+ private:
+  void Work(uint32_t worker, const Task_t &task);
+  bool PopTask(uint32_t worker, uint32_t &task);
+
+  class TTaskQueue
+  {
+   public:
+    std::mutex mutex;
+    std::deque<uint32_t> tasks;
+    uint32_t nReserved = 0;  // at the front, by PeekTasks()
+  };
+
+  uint32_t fNThreads;
+  std::vector<std::unique_ptr<TTaskQueue>> fQueues;
+  std::atomic<uint64_t> fNSteals = 0;
+
+  // Each element is written by its worker only
+  double_t fRunTime = 0.;
+  std::vector<double_t> fBusyTime;
+  std::vector<uint32_t> fNTasks;
+};
+
+#endif
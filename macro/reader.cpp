@@ -17,8 +17,12 @@
 #include <thread>
 #include <vector>
 
+#include "TCalibrationTable.hpp"
 #include "TChSettings.hpp"
+#include "TCompactHist2D.hpp"
 #include "TEventData.hpp"
+#include "TEventReader.hpp"
+#include "TLocalHist.hpp"
 
 std::vector<std::string> GetFileList(const std::string dirName)
 {
@@ -36,56 +40,67 @@ std::vector<std::string> GetFileList(const std::string dirName)
 
 Double_t GetCalibratedEnergy(const ChSettings_t &chSetting, const UShort_t &adc)
 {
-  return chSetting.p0 + chSetting.p1 * adc + chSetting.p2 * adc * adc +
-         chSetting.p3 * adc * adc * adc;
+  return chSetting.GetCalibratedEnergy(adc);
 }
 
+// Each analysis thread fills its own counts of the histograms, added up by
+// MergeHists() when all threads are done.  The 288 large per-channel maps
+// are kept compact, their TH2D are only made by Get().
 constexpr uint32_t nModules = 9;
 constexpr uint32_t nChannels = 16;
-TH2D *histTime[nChannels + 1];
-TH1D *histSiMultiplicty;
-TH1D *histGammaMultiplicity;
-TH1D *histNeutronMultiplicity;
-TH1D *histADC[nModules][nChannels];
-TH1D *histEnergy[nModules][nChannels];
-TH2D *histADCvsTime[nModules][nChannels];
-TH2D *histPSDvsTime[nModules][nChannels];
-void InitHists()
+TLocalHist<TH2D> *histTime[nChannels + 1];
+TLocalHist<TH1D> *histSiMultiplicty;
+TLocalHist<TH1D> *histGammaMultiplicity;
+TLocalHist<TH1D> *histNeutronMultiplicity;
+TLocalHist<TH1D> *histADC[nModules][nChannels];
+TLocalHist<TH1D> *histEnergy[nModules][nChannels];
+TCalibrationTable *energyTable[nModules][nChannels];  // ADC -> histEnergy bin
+TCompactHist2D *histADCvsTime[nModules][nChannels];
+TCompactHist2D *histPSDvsTime[nModules][nChannels];
+void InitHists(uint32_t nWorkers)
 {
   auto settingsFileName = "./chSettings.json";
   auto chSettingsVec = TChSettings::GetChSettings(settingsFileName);
 
   for (uint32_t i = 0; i < nChannels; i++) {
-    histTime[i] =
+    histTime[i] = new TLocalHist(
         new TH2D(Form("histTime_%d", i),
                  Form("Time difference ID%02d and other detectors", i), 20000,
-                 -1000, 1000, 151, -0.5, 150.5);
-    histTime[i]->SetXTitle("[ns]");
-    histTime[i]->SetYTitle("Detector ID");
+                 -1000, 1000, 151, -0.5, 150.5),
+        nWorkers);
+    histTime[i]->Get()->SetXTitle("[ns]");
+    histTime[i]->Get()->SetYTitle("Detector ID");
   }
-  histTime[nChannels] =
+  histTime[nChannels] = new TLocalHist(
       new TH2D("histTime", "Time difference between detectors", 20000, -1000,
-               1000, 151, -0.5, 150.5);
+               1000, 151, -0.5, 150.5),
+      nWorkers);
 
-  histSiMultiplicty =
-      new TH1D("histSiMultiplicity", "Si Multiplicity", 33, -0.5, 32.5);
-  histSiMultiplicty->SetXTitle("Multiplicity");
+  histSiMultiplicty = new TLocalHist(
+      new TH1D("histSiMultiplicity", "Si Multiplicity", 33, -0.5, 32.5),
+      nWorkers);
+  histSiMultiplicty->Get()->SetXTitle("Multiplicity");
 
-  histGammaMultiplicity =
-      new TH1D("histGammaMultiplicity", "Gamma Multiplicity", 48, -0.5, 47.5);
-  histGammaMultiplicity->SetXTitle("Multiplicity");
+  histGammaMultiplicity = new TLocalHist(
+      new TH1D("histGammaMultiplicity", "Gamma Multiplicity", 48, -0.5, 47.5),
+      nWorkers);
+  histGammaMultiplicity->Get()->SetXTitle("Multiplicity");
 
-  histNeutronMultiplicity = new TH1D("histNeutronMultiplicity",
-                                     "Neutron Multiplicity", 48, -0.5, 47.5);
-  histNeutronMultiplicity->SetXTitle("Multiplicity");
+  histNeutronMultiplicity =
+      new TLocalHist(new TH1D("histNeutronMultiplicity",
+                              "Neutron Multiplicity", 48, -0.5, 47.5),
+                     nWorkers);
+  histNeutronMultiplicity->Get()->SetXTitle("Multiplicity");
 
   constexpr uint32_t nBins = 32000;
   for (uint32_t i = 0; i < nModules; i++) {
     for (uint32_t j = 0; j < nChannels; j++) {
-      histADC[i][j] = new TH1D(Form("histADC_%d_%d", i, j),
-                               Form("Energy Module%02d Channel%02d", i, j),
-                               nBins, 0.5, nBins + 0.5);
-      histADC[i][j]->SetXTitle("ADC channel");
+      histADC[i][j] =
+          new TLocalHist(new TH1D(Form("histADC_%d_%d", i, j),
+                                  Form("Energy Module%02d Channel%02d", i, j),
+                                  nBins, 0.5, nBins + 0.5),
+                         nWorkers);
+      histADC[i][j]->Get()->SetXTitle("ADC channel");
     }
   }
 
@@ -105,19 +120,23 @@ void InitHists()
         }
         binTable.at(k) = nextEdge;
       }
-      histEnergy[i][j] = new TH1D(Form("histEnergy_%d_%d", i, j),
+      histEnergy[i][j] =
+          new TLocalHist(new TH1D(Form("histEnergy_%d_%d", i, j),
                                   Form("Energy Module%02d Channel%02d", i, j),
-                                  nBins, binTable.data());
-      histEnergy[i][j]->SetXTitle("Energy [keV]");
+                                  nBins, binTable.data()),
+                         nWorkers);
+      histEnergy[i][j]->Get()->SetXTitle("Energy [keV]");
+      energyTable[i][j] =
+          new TCalibrationTable(chSetting, histEnergy[i][j]->Get()->GetXaxis());
     }
   }
 
   for (uint32_t i = 0; i < nModules; i++) {
     for (uint32_t j = 0; j < nChannels; j++) {
-      histADCvsTime[i][j] =
-          new TH2D(Form("histADCvsTime_%d_%d", i, j),
-                   Form("Energy vs Time Module%02d Channel%02d", i, j), 2000,
-                   -1000, 1000, nBins / 10, 0.5, nBins + 0.5);
+      histADCvsTime[i][j] = new TCompactHist2D(
+          Form("histADCvsTime_%d_%d", i, j),
+          Form("Energy vs Time Module%02d Channel%02d", i, j), 2000, -1000,
+          1000, nBins / 10, 0.5, nBins + 0.5, nWorkers);
       histADCvsTime[i][j]->SetXTitle("Time [ns]");
       histADCvsTime[i][j]->SetYTitle("ADC channel");
     }
@@ -125,16 +144,47 @@ void InitHists()
 
   for (uint32_t i = 0; i < nModules; i++) {
     for (uint32_t j = 0; j < nChannels; j++) {
-      histPSDvsTime[i][j] =
-          new TH2D(Form("histPSDvsTime_%d_%d", i, j),
-                   Form("PSD vs Time Module%02d Channel%02d", i, j), 2000,
-                   -1000, 1000, 1000, 0, 1);
+      histPSDvsTime[i][j] = new TCompactHist2D(
+          Form("histPSDvsTime_%d_%d", i, j),
+          Form("PSD vs Time Module%02d Channel%02d", i, j), 2000, -1000, 1000,
+          1000, 0, 1, nWorkers);
       histPSDvsTime[i][j]->SetXTitle("Time [ns]");
       histPSDvsTime[i][j]->SetYTitle("PSD");
     }
   }
 }
 
+void MergeHists()
+{
+  for (auto hist : histTime) hist->Merge();
+  histSiMultiplicty->Merge();
+  histGammaMultiplicity->Merge();
+  histNeutronMultiplicity->Merge();
+  for (uint32_t i = 0; i < nModules; i++) {
+    for (uint32_t j = 0; j < nChannels; j++) {
+      histADC[i][j]->Merge();
+      histEnergy[i][j]->Merge();
+      histADCvsTime[i][j]->Merge();
+      histPSDvsTime[i][j]->Merge();
+    }
+  }
+}
+
+// All hits of the event: bin and keV from the table, one count each
+void FillEnergy(uint32_t worker, const std::vector<uint8_t> &Module,
+                const std::vector<uint8_t> &Channel,
+                const std::vector<uint16_t> &Energy)
+{
+  const auto nHits = Module.size();
+  for (size_t j = 0; j < nHits; j++) {
+    const auto module = Module[j];
+    const auto channel = Channel[j];
+    const auto &table = *energyTable[module][channel];
+    histEnergy[module][channel]->FillBin(worker, table.GetBin(Energy[j]),
+                                         table.GetEnergy(Energy[j]));
+  }
+}
+
 std::mutex counterMutex;
 uint64_t totalEvents = 0;
 uint64_t processedEvents = 0;
@@ -144,8 +194,6 @@ void AnalysisThread(TString fileName, uint32_t threadID)
   ROOT::EnableThreadSafety();
 
   counterMutex.lock();
-  auto settingsFileName = "./chSettings.json";
-  auto chSettingsVec = TChSettings::GetChSettings(settingsFileName);
   auto siTimeFunction = "Si_time_function.txt";
   std::vector<double_t> p0Vec;
   std::vector<double_t> p1Vec;
@@ -172,50 +220,31 @@ void AnalysisThread(TString fileName, uint32_t threadID)
   ifs.close();
   counterMutex.unlock();
 
-  auto file = TFile::Open(fileName, "READ");
-  if (!file) {
-    std::cerr << "File not found: events.root" << std::endl;
-    return;
-  }
-  auto tree = dynamic_cast<TTree *>(file->Get("Event_Tree"));
-  if (!tree) {
-    std::cerr << "Tree not found: Event_Tree" << std::endl;
+  TEventReader event(fileName.Data());
+  if (!event.IsOpen()) {
     return;
   }
-
-  bool IsFissionEvent;
-  tree->SetBranchAddress("IsFissionEvent", &IsFissionEvent);
-  uint8_t TriggerID;
-  tree->SetBranchAddress("TriggerID", &TriggerID);
-  uint8_t SiFrontMultiplicity;
-  tree->SetBranchAddress("SiFrontMultiplicity", &SiFrontMultiplicity);
-  uint8_t SiBackMultiplicity;
-  tree->SetBranchAddress("SiBackMultiplicity", &SiBackMultiplicity);
-  uint8_t SiMultiplicity;
-  tree->SetBranchAddress("SiMultiplicity", &SiMultiplicity);
-  uint8_t GammaMultiplicity;
-  tree->SetBranchAddress("GammaMultiplicity", &GammaMultiplicity);
-  uint8_t NeutronMultiplicity;
-  tree->SetBranchAddress("NeutronMultiplicity", &NeutronMultiplicity);
-  std::vector<uint8_t> *Module = nullptr;
-  tree->SetBranchAddress("Module", &Module);
-  std::vector<uint8_t> *Channel = nullptr;
-  tree->SetBranchAddress("Channel", &Channel);
-  std::vector<double_t> *Timestamp = nullptr;
-  tree->SetBranchAddress("Timestamp", &Timestamp);
-  std::vector<uint16_t> *Energy = nullptr;
-  tree->SetBranchAddress("Energy", &Energy);
-  std::vector<uint16_t> *EnergyShort = nullptr;
-  tree->SetBranchAddress("EnergyShort", &EnergyShort);
-
-  const auto nEntries = tree->GetEntries();
+  auto &IsFissionEvent = event.IsFissionEvent;
+  auto &TriggerID = event.TriggerID;
+  auto &SiFrontMultiplicity = event.SiFrontMultiplicity;
+  auto &SiBackMultiplicity = event.SiBackMultiplicity;
+  auto &SiMultiplicity = event.SiMultiplicity;
+  auto &GammaMultiplicity = event.GammaMultiplicity;
+  auto &NeutronMultiplicity = event.NeutronMultiplicity;
+  auto Module = &event.Module;
+  auto Channel = &event.Channel;
+  auto Timestamp = &event.Timestamp;
+  auto Energy = &event.Energy;
+  auto EnergyShort = &event.EnergyShort;
+
+  const auto nEntries = event.GetEntries();
   {
     std::lock_guard<std::mutex> lock(counterMutex);
     totalEvents += nEntries;
   }
 
   for (auto i = 0; i < nEntries; i++) {
-    tree->GetEntry(i);
+    event.GetEntry(i);
     constexpr auto nProcess = 1000;
     if (i % nProcess == 0) {
       std::lock_guard<std::mutex> lock(counterMutex);
@@ -241,9 +270,11 @@ void AnalysisThread(TString fileName, uint32_t threadID)
                  p3Vec.at(SiCh) * SiEnergy * SiEnergy * SiEnergy;
       }
 
-      histSiMultiplicty->Fill(SiMultiplicity);
-      histGammaMultiplicity->Fill(GammaMultiplicity);
-      histNeutronMultiplicity->Fill(NeutronMultiplicity);
+      histSiMultiplicty->Fill(threadID, SiMultiplicity);
+      histGammaMultiplicity->Fill(threadID, GammaMultiplicity);
+      histNeutronMultiplicity->Fill(threadID, NeutronMultiplicity);
+
+      FillEnergy(threadID, *Module, *Channel, *Energy);
 
       auto triggerCh = TriggerID % 16;
       for (uint32_t j = 0; j < Module->size(); j++) {
@@ -253,22 +284,17 @@ void AnalysisThread(TString fileName, uint32_t threadID)
         // auto timestamp = Timestamp->at(j);
         auto energy = Energy->at(j);
         auto energyShort = EnergyShort->at(j);
-        auto chSetting = chSettingsVec.at(module).at(channel);
-        auto calibratedEnergy = GetCalibratedEnergy(chSetting, energy);
-        auto calibratedEnergyShort =
-            GetCalibratedEnergy(chSetting, energyShort);
         auto psd = double(energy - energyShort) / double(energy);
 
         auto hitID = module * 16 + channel;
         // if (module != 0) {
-        histTime[triggerCh]->Fill(timestamp, hitID);
-        histTime[16]->Fill(timestamp, hitID);  // Sum of all
+        histTime[triggerCh]->Fill(threadID, timestamp, hitID);
+        histTime[16]->Fill(threadID, timestamp, hitID);  // Sum of all
         // }
 
-        histADC[module][channel]->Fill(energy);
-        histEnergy[module][channel]->Fill(calibratedEnergy);
-        histADCvsTime[module][channel]->Fill(timestamp, energy);
-        histPSDvsTime[module][channel]->Fill(timestamp, psd);
+        histADC[module][channel]->Fill(threadID, energy);
+        histADCvsTime[module][channel]->Fill(threadID, timestamp, energy);
+        histPSDvsTime[module][channel]->Fill(threadID, timestamp, psd);
       }
     }
   }
@@ -280,10 +306,10 @@ void reader()
 {
   ROOT::EnableThreadSafety();
 
-  InitHists();
-
   auto fileList = GetFileList("./");
 
+  InitHists(fileList.size());
+
   auto startTime = std::chrono::high_resolution_clock::now();
   auto lastTime = startTime;
 
@@ -323,6 +349,7 @@ void reader()
   for (auto &thread : threads) {
     thread.join();
   }
+  MergeHists();
 
   auto endTime = std::chrono::high_resolution_clock::now();
   auto elapsed =
@@ -355,5 +382,5 @@ void reader()
   // }
 
   auto canvas = new TCanvas("canvas", "canvas", 800, 600);
-  histTime[16]->Draw("colz");
+  histTime[16]->Get()->Draw("colz");
 }
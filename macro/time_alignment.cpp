@@ -19,6 +19,8 @@
 
 #include "TChSettings.hpp"
 #include "TEventData.hpp"
+#include "TEventReader.hpp"
+#include "TLocalHist.hpp"
 
 std::vector<std::string> GetFileList(const std::string dirName)
 {
@@ -36,15 +38,25 @@ std::vector<std::string> GetFileList(const std::string dirName)
 
 constexpr uint32_t nModules = 9;
 constexpr uint32_t nChannels = 16;
-TH2D *histTime;
-TH1D *histTriggerADC;
-void InitHists()
+// Filled per thread, added up by MergeHists() when all threads are done
+TLocalHist<TH2D> *histTime;
+TLocalHist<TH1D> *histTriggerADC;
+void InitHists(uint32_t nWorkers)
 {
-  histTime = new TH2D("histTime", "Time difference between detectors", 20000,
-                      -1000, 1000, 151, -0.5, 150.5);
+  histTime = new TLocalHist(
+      new TH2D("histTime", "Time difference between detectors", 20000, -1000,
+               1000, 151, -0.5, 150.5),
+      nWorkers);
+
+  histTriggerADC = new TLocalHist(
+      new TH1D("histTriggerADC", "Trigger ADC", 32000, 0.5, 32000.5),
+      nWorkers);
+}
 
-  histTriggerADC =
-      new TH1D("histTriggerADC", "Trigger ADC", 32000, 0.5, 32000.5);
+void MergeHists()
+{
+  histTime->Merge();
+  histTriggerADC->Merge();
 }
 
 void FitSiHist(TH1D *hist)
@@ -96,32 +108,16 @@ void AnalysisThread(TString fileName, uint32_t threadID)
   auto chSettingsVec = TChSettings::GetChSettings(settingsFileName);
   counterMutex.unlock();
 
-  auto file = TFile::Open(fileName, "READ");
-  if (!file) {
-    std::cerr << "File not found: events.root" << std::endl;
-    return;
-  }
-  auto tree = dynamic_cast<TTree *>(file->Get("Event_Tree"));
-  if (!tree) {
-    std::cerr << "Tree not found: Event_Tree" << std::endl;
+  TEventReader event(fileName.Data(), {"Module", "Channel", "Timestamp", "Energy"});
+  if (!event.IsOpen()) {
     return;
   }
-  tree->SetBranchStatus("*", kFALSE);
-
-  std::vector<uint8_t> *Module = nullptr;
-  tree->SetBranchStatus("Module", kTRUE);
-  tree->SetBranchAddress("Module", &Module);
-  std::vector<uint8_t> *Channel = nullptr;
-  tree->SetBranchStatus("Channel", kTRUE);
-  tree->SetBranchAddress("Channel", &Channel);
-  std::vector<double_t> *Timestamp = nullptr;
-  tree->SetBranchStatus("Timestamp", kTRUE);
-  tree->SetBranchAddress("Timestamp", &Timestamp);
-  std::vector<uint16_t> *ADC = nullptr;
-  tree->SetBranchStatus("Energy", kTRUE);
-  tree->SetBranchAddress("Energy", &ADC);
-
-  const auto nEntries = tree->GetEntries();
+  auto Module = &event.Module;
+  auto Channel = &event.Channel;
+  auto Timestamp = &event.Timestamp;
+  auto ADC = &event.Energy;
+
+  const auto nEntries = event.GetEntries();
   {
     std::lock_guard<std::mutex> lock(counterMutex);
     totalEvents += nEntries;
@@ -133,7 +129,7 @@ void AnalysisThread(TString fileName, uint32_t threadID)
       std::lock_guard<std::mutex> lock(counterMutex);
       processedEvents += nProcess;
     }
-    tree->GetEntry(i);
+    event.GetEntry(i);
 
     bool isCo = false;
     for (uint32_t i = 0; i < Module->size(); i++) {
@@ -149,13 +145,13 @@ void AnalysisThread(TString fileName, uint32_t threadID)
     for (uint32_t j = 0; j < Module->size(); j++) {
       auto timestamp = Timestamp->at(j);
       if (timestamp == 0) {
-        histTriggerADC->Fill(ADC->at(j));
+        histTriggerADC->Fill(threadID, ADC->at(j));
       } else {
         auto module = Module->at(j);
         auto channel = Channel->at(j);
         auto hitID = module * 16 + channel;
         if (isCo || module == 0 || module == 1)
-          histTime->Fill(timestamp, hitID);
+          histTime->Fill(threadID, timestamp, hitID);
       }
     }
   }
@@ -167,10 +163,10 @@ void time_alignment()
 {
   ROOT::EnableThreadSafety();
 
-  InitHists();
-
   auto fileList = GetFileList("./");
 
+  InitHists(fileList.size());
+
   auto startTime = std::chrono::high_resolution_clock::now();
   auto lastTime = startTime;
 
@@ -210,6 +206,7 @@ void time_alignment()
   for (auto &thread : threads) {
     thread.join();
   }
+  MergeHists();
 
   auto endTime = std::chrono::high_resolution_clock::now();
   auto elapsed =
@@ -235,7 +232,7 @@ void time_alignment()
                                            std::vector<TH1D *>(nChannels));
   for (uint32_t i = 0; i < nModules; i++) {
     for (uint32_t j = 0; j < nChannels; j++) {
-      histTof.at(i).at(j) = histTime->ProjectionX(
+      histTof.at(i).at(j) = histTime->Get()->ProjectionX(
           Form("histTof_%d_%d", i, j), i * 16 + j + 1, i * 16 + j + 1);
       histTof.at(i).at(j)->SetTitle(
           Form("Time of flight for Module %d, Channel %d", i, j));
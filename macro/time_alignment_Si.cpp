@@ -21,6 +21,8 @@
 
 #include "TChSettings.hpp"
 #include "TEventData.hpp"
+#include "TEventReader.hpp"
+#include "TLocalHist.hpp"
 
 std::vector<std::string> GetFileList(const std::string dirName)
 {
@@ -38,16 +40,27 @@ std::vector<std::string> GetFileList(const std::string dirName)
 
 constexpr uint32_t nModules = 1;
 constexpr uint32_t nChannels = 16;
-TH2D *histTimeADC[nModules][nChannels];
-void InitHists()
+// Filled per thread, added up by MergeHists() when all threads are done
+TLocalHist<TH2D> *histTimeADC[nModules][nChannels];
+void InitHists(uint32_t nWorkers)
 {
   for (uint32_t i = 0; i < nModules; i++) {
     for (uint32_t j = 0; j < nChannels; j++) {
-      histTimeADC[i][j] = new TH2D(Form("histTimeADC_%d_%d", i, j),
-                                   Form("Module %d, Channel %d", i, j), 250,
-                                   -1000, 1000, 500, 2000.5, 12000.5);
-      histTimeADC[i][j]->GetXaxis()->SetTitle("Time (ns)");
-      histTimeADC[i][j]->GetYaxis()->SetTitle("ADC");
+      auto hist = new TH2D(Form("histTimeADC_%d_%d", i, j),
+                           Form("Module %d, Channel %d", i, j), 250, -1000,
+                           1000, 500, 2000.5, 12000.5);
+      hist->GetXaxis()->SetTitle("Time (ns)");
+      hist->GetYaxis()->SetTitle("ADC");
+      histTimeADC[i][j] = new TLocalHist(hist, nWorkers);
+    }
+  }
+}
+
+void MergeHists()
+{
+  for (uint32_t i = 0; i < nModules; i++) {
+    for (uint32_t j = 0; j < nChannels; j++) {
+      histTimeADC[i][j]->Merge();
     }
   }
 }
@@ -87,35 +100,17 @@ void AnalysisThread(TString fileName, uint32_t threadID)
   auto chSettingsVec = TChSettings::GetChSettings(settingsFileName);
   counterMutex.unlock();
 
-  auto file = TFile::Open(fileName, "READ");
-  if (!file) {
-    std::cerr << "File not found: events.root" << std::endl;
-    return;
-  }
-  auto tree = dynamic_cast<TTree *>(file->Get("Event_Tree"));
-  if (!tree) {
-    std::cerr << "Tree not found: Event_Tree" << std::endl;
+  TEventReader event(fileName.Data(), {"IsFissionEvent", "Module", "Channel", "Timestamp", "Energy"});
+  if (!event.IsOpen()) {
     return;
   }
-  tree->SetBranchStatus("*", kFALSE);
-
-  bool IsFissionEvent;
-  tree->SetBranchStatus("IsFissionEvent", kTRUE);
-  tree->SetBranchAddress("IsFissionEvent", &IsFissionEvent);
-  std::vector<uint8_t> *Module = nullptr;
-  tree->SetBranchStatus("Module", kTRUE);
-  tree->SetBranchAddress("Module", &Module);
-  std::vector<uint8_t> *Channel = nullptr;
-  tree->SetBranchStatus("Channel", kTRUE);
-  tree->SetBranchAddress("Channel", &Channel);
-  std::vector<double_t> *Timestamp = nullptr;
-  tree->SetBranchStatus("Timestamp", kTRUE);
-  tree->SetBranchAddress("Timestamp", &Timestamp);
-  std::vector<uint16_t> *ADC = nullptr;
-  tree->SetBranchStatus("Energy", kTRUE);
-  tree->SetBranchAddress("Energy", &ADC);
-
-  const auto nEntries = tree->GetEntries();
+  auto &IsFissionEvent = event.IsFissionEvent;
+  auto Module = &event.Module;
+  auto Channel = &event.Channel;
+  auto Timestamp = &event.Timestamp;
+  auto ADC = &event.Energy;
+
+  const auto nEntries = event.GetEntries();
   {
     std::lock_guard<std::mutex> lock(counterMutex);
     totalEvents += nEntries;
@@ -127,7 +122,7 @@ void AnalysisThread(TString fileName, uint32_t threadID)
       std::lock_guard<std::mutex> lock(counterMutex);
       processedEvents += nProcess;
     }
-    tree->GetEntry(i);
+    event.GetEntry(i);
 
     if (!IsFissionEvent) {
       continue;
@@ -139,7 +134,7 @@ void AnalysisThread(TString fileName, uint32_t threadID)
       auto channel = Channel->at(j);
       auto adc = ADC->at(j);
       if (module < nModules && channel < nChannels && timestamp != 0) {
-        histTimeADC[module][channel]->Fill(timestamp, adc);
+        histTimeADC[module][channel]->Fill(threadID, timestamp, adc);
       }
     }
   }
@@ -152,10 +147,10 @@ void time_alignment_Si()
 {
   ROOT::EnableThreadSafety();
 
-  InitHists();
-
   auto fileList = GetFileList("./");
 
+  InitHists(fileList.size());
+
   auto startTime = std::chrono::high_resolution_clock::now();
   auto lastTime = startTime;
 
@@ -195,6 +190,7 @@ void time_alignment_Si()
   for (auto &thread : threads) {
     thread.join();
   }
+  MergeHists();
 
   auto endTime = std::chrono::high_resolution_clock::now();
   auto elapsed =
@@ -211,13 +207,14 @@ void time_alignment_Si()
   for (uint32_t j = 0; j < nChannels; j++) {
     std::vector<TH1D *> histTimeVec;
 
-    const auto nBins = histTimeADC[0][j]->GetNbinsY();
-    const auto maxBinContent = histTimeADC[0][j]->ProjectionX()->GetMaximum();
+    auto histTimeADC0 = histTimeADC[0][j]->Get();
+    const auto nBins = histTimeADC0->GetNbinsY();
+    const auto maxBinContent = histTimeADC0->ProjectionX()->GetMaximum();
     auto timeOffset = jsonFile.at(0).at(j).at("TimeOffset").get<double>();
     for (auto i = 1; i <= nBins; i++) {
-      auto hist = histTimeADC[0][j]->ProjectionX(Form("histTime_%d", i), i, i);
+      auto hist = histTimeADC0->ProjectionX(Form("histTime_%d", i), i, i);
       if (hist->GetEntries() > 0.01 * maxBinContent) {
-        auto binCenter = histTimeADC[0][j]->GetYaxis()->GetBinCenter(i);
+        auto binCenter = histTimeADC0->GetYaxis()->GetBinCenter(i);
         hist->SetTitle(Form("%.0f", binCenter));
         histTimeVec.push_back(hist);
       }
@@ -1,17 +1,29 @@
+#include <TFileMerger.h>
 #include <TROOT.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <filesystem>
 #include <iostream>
 #include <memory>
 #include <mutex>
 #include <nlohmann/json.hpp>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "TCampaign.hpp"
 #include "TChSettings.hpp"
 #include "TEventBuilder.hpp"
 #include "TFileWriter.hpp"
+#include "THitPrefetcher.hpp"
+#include "THitReader.hpp"
+#include "TMemoryBudget.hpp"
+#include "TOutputSettings.hpp"
+#include "TProcessPool.hpp"
+#include "TTimeAligner.hpp"
+#include "TWorkStealingPool.hpp"
 
 std::vector<std::string> GetFileList(const std::string &directory,
                                      const uint32_t runNumber,
@@ -36,18 +48,196 @@ std::vector<std::string> GetFileList(const std::string &directory,
   return fileList;
 }
 
+// Largest first, by the number of hits (file size for the same number).
+// The cost of building a file goes with its number of hits.  Returns the
+// number of hits of the sorted files.
+std::vector<Long64_t> SortFileList(std::vector<std::string> &fileList)
+{
+  std::vector<std::pair<Long64_t, uintmax_t>> fileCost;
+  for (const auto &fileName : fileList) {
+    std::error_code error;
+    auto size = std::filesystem::file_size(fileName, error);
+    fileCost.push_back({THitReader::GetNEntries(fileName), error ? 0 : size});
+  }
+  std::vector<uint32_t> order(fileList.size());
+  for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return fileCost[a] > fileCost[b];
+  });
+  std::vector<std::string> sorted;
+  std::vector<Long64_t> nHits;
+  for (auto i : order) {
+    sorted.push_back(fileList[i]);
+    nHits.push_back(fileCost[i].first);
+  }
+  fileList.swap(sorted);
+  return nHits;
+}
+
+// Process mode: collects the progress messages of the worker processes and
+// merges their output files when a single output file is asked for
+int RunCoordinator(TProcessPool &processPool, uint32_t nFiles,
+                   bool singleOutputFile, int32_t compression,
+                   std::chrono::high_resolution_clock::time_point start)
+{
+  uint32_t nDone = 0;
+  uint64_t nHits = 0;
+  uint64_t nEvents = 0;
+  std::vector<std::string> outputFiles;
+  auto nFailed = processPool.Wait([&](uint32_t worker,
+                                      const std::string &message) {
+    std::istringstream line(message);
+    std::string type;
+    line >> type;
+    if (type == "file") {
+      uint64_t fileHits = 0;
+      uint64_t fileEvents = 0;
+      std::string fileName;
+      line >> fileHits >> fileEvents;
+      std::getline(line >> std::ws, fileName);
+      nDone++;
+      nHits += fileHits;
+      nEvents += fileEvents;
+      std::cout << "[" << nDone << "/" << nFiles << "] " << fileName << " : "
+                << fileHits << " hits, " << fileEvents
+                << " events (process " << worker << ")" << std::endl;
+    } else if (type == "output") {
+      std::string fileName;
+      std::getline(line >> std::ws, fileName);
+      outputFiles.push_back(fileName);
+    }
+  });
+  if (nFailed > 0) {
+    std::cerr << "Worker processes failed: " << nFailed
+              << ", see their log files." << std::endl;
+  }
+
+  if (singleOutputFile && nFailed == 0) {
+    auto outputName = "events_t0.root";
+    TFileMerger merger(kFALSE);
+    if (compression >= 0) {
+      merger.OutputFile(outputName, "RECREATE", compression);
+    } else {
+      merger.OutputFile(outputName, "RECREATE");
+    }
+    for (const auto &fileName : outputFiles) {
+      merger.AddFile(fileName.c_str(), kFALSE);
+    }
+    if (merger.Merge()) {
+      for (const auto &fileName : outputFiles) {
+        std::filesystem::remove(fileName);
+      }
+      outputFiles = {outputName};
+    } else {
+      std::cerr << "Merging the output files failed." << std::endl;
+      nFailed++;
+    }
+  }
+  for (const auto &fileName : outputFiles) {
+    std::cout << "Output file: " << fileName << std::endl;
+  }
+
+  std::cout << "Number of hits: " << nHits << std::endl;
+  std::cout << "Number of events: " << nEvents << std::endl;
+  auto end = std::chrono::high_resolution_clock::now();
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+          .count();
+  std::cout << "Elapsed time: " << elapsed / 1.e3 << " s" << std::endl;
+
+  return (nFailed > 0) ? 1 : 0;
+}
+
+// Campaign mode: the runs and their versions, VersionsPerUnit versions per
+// work unit (the units without files are left out), handed to the workers
+// through the lease directory
+int RunCampaign(const std::string &campaignDirectory,
+                const nlohmann::json &jSettings, const std::string &directory,
+                const std::string &chSettingFileName, uint32_t runNumber,
+                uint32_t startVersion, uint32_t endVersion,
+                const std::string &executable)
+{
+  // Optional keys of the campaign mode
+  std::vector<uint32_t> runs =
+      jSettings.value("Runs", std::vector<uint32_t>{runNumber});
+  uint32_t versionsPerUnit =
+      std::max(jSettings.value("VersionsPerUnit", 20), 1);
+  double_t leaseTimeout = jSettings.value("LeaseTimeout", 600.);
+  uint32_t nLocalWorkers = jSettings.value("LocalWorkers", 0);
+  if (leaseTimeout < 3 * TCampaign::kHeartbeatInterval) {
+    std::cerr << "LeaseTimeout must be at least "
+              << 3 * TCampaign::kHeartbeatInterval << " s." << std::endl;
+    return 1;
+  }
+
+  std::vector<TWorkUnit> units;
+  for (auto run : runs) {
+    for (auto first = startVersion; first <= endVersion;
+         first += versionsPerUnit) {
+      auto last = std::min(first + versionsPerUnit - 1, endVersion);
+      if (GetFileList(directory, run, first, last).size() > 0) {
+        units.push_back(TWorkUnit(run, first, last));
+      }
+    }
+  }
+
+  // The units are built in other directories, on other nodes
+  auto campaignSettings = jSettings;
+  campaignSettings["Directory"] = std::filesystem::absolute(directory);
+  campaignSettings["ChannelSettings"] =
+      std::filesystem::absolute(chSettingFileName);
+  campaignSettings["MaxRetries"] = jSettings.value("MaxRetries", 2);
+  TCampaign campaign(campaignDirectory);
+  campaign.Create(campaignSettings, units);
+
+  // Workers on this node, started with the coordinator
+  std::unique_ptr<TProcessPool> localWorkers;
+  if (nLocalWorkers > 0) {
+    localWorkers = std::make_unique<TProcessPool>(nLocalWorkers);
+    if (localWorkers->Fork() != TProcessPool::kCoordinator) {
+      return (campaign.Work(executable) > 0) ? 1 : 0;
+    }
+  }
+  auto nFailed = campaign.Coordinate(leaseTimeout);
+  if (localWorkers) {
+    localWorkers->Wait([](uint32_t, const std::string &) {});
+  }
+  return (nFailed > 0) ? 1 : 0;
+}
+
 int main(int argc, char *argv[])
 {
   bool interactionMode = true;
   std::string settingsFileName = "settings.json";
+  std::string coordinatorDirectory = "";
+  std::string workerDirectory = "";
+  bool alignMode = false;
+  for (auto i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--align") alignMode = true;
+  }
   if (argc > 1) {
-    for (auto i = 1; i < argc; i++) {
+    for (auto i = 1; i + 1 < argc; i++) {
       if (std::string(argv[i]) == "-b") {
         interactionMode = false;
         settingsFileName = argv[i + 1];
+      } else if (std::string(argv[i]) == "--coordinator") {
+        interactionMode = false;
+        coordinatorDirectory = argv[i + 1];
+      } else if (std::string(argv[i]) == "--worker") {
+        workerDirectory = argv[i + 1];
       }
     }
   }
+  // The workers of a campaign start this executable for every unit
+  std::error_code exeError;
+  auto executable = std::filesystem::read_symlink("/proc/self/exe", exeError);
+  if (exeError) {
+    executable = std::filesystem::absolute(argv[0]);
+  }
+  if (workerDirectory != "") {
+    TCampaign campaign(workerDirectory);
+    return (campaign.Work(executable) > 0) ? 1 : 0;
+  }
 
   // auto nThreads = std::thread::hardware_concurrency();
   // std::cout << "Number of threads: " << nThreads << std::endl;
@@ -145,6 +335,110 @@ int main(int argc, char *argv[])
     return 1;
   }
 
+  // Optional key: handling of the triggers inside an event window
+  auto overlapPolicy = OverlapPolicy::DeadTime;
+  std::string overlapPolicyName = jSettings.value("OverlapPolicy", "DeadTime");
+  if (overlapPolicyName == "AllowOverlap") {
+    overlapPolicy = OverlapPolicy::AllowOverlap;
+  } else if (overlapPolicyName == "Merge") {
+    overlapPolicy = OverlapPolicy::Merge;
+  } else if (overlapPolicyName != "DeadTime") {
+    std::cerr << "Unknown overlap policy: " << overlapPolicyName << std::endl;
+    std::cerr << "Key \"OverlapPolicy\" is DeadTime, AllowOverlap or Merge."
+              << std::endl;
+    return 1;
+  }
+
+  // Optional keys: streaming mode with bounded memory
+  bool streamingMode = jSettings.value("StreamingMode", false);
+  uint32_t chunkSize = jSettings.value("ChunkSize", 1000000);
+  double_t maxTimeDisorder = jSettings.value("MaxTimeDisorder", 1000000.);
+  // Optional keys: whole run as one continuous hit stream
+  bool runStreamMode = jSettings.value("RunStreamMode", false);
+  uint32_t readAheadDepth = jSettings.value("ReadAheadDepth", 2);
+  // Optional key: TTree or RNTuple
+  auto outputFormat = OutputFormat::TTree;
+  std::string outputFormatName = jSettings.value("OutputFormat", "TTree");
+  if (outputFormatName == "RNTuple") {
+    outputFormat = OutputFormat::RNTuple;
+  } else if (outputFormatName != "TTree") {
+    std::cerr << "Unknown output format: " << outputFormatName << std::endl;
+    std::cerr << "Key \"OutputFormat\" is TTree or RNTuple." << std::endl;
+    return 1;
+  }
+  // Optional keys: schema of the hits, compression and basket size
+  TOutputSettings outputSettings;
+  outputSettings.compactHits = jSettings.value("CompactOutput", false);
+  std::string compressionAlgorithm =
+      jSettings.value("CompressionAlgorithm", "Default");
+  int32_t compressionLevel = jSettings.value("CompressionLevel", 5);
+  outputSettings.compression =
+      TOutputSettings::GetCompression(compressionAlgorithm, compressionLevel);
+  if (outputSettings.compression == TOutputSettings::kUnknownCompression) {
+    std::cerr << "Unknown compression algorithm: " << compressionAlgorithm
+              << std::endl;
+    std::cerr << "Key \"CompressionAlgorithm\" is Default, ZLIB, LZMA, LZ4 "
+                 "or ZSTD."
+              << std::endl;
+    return 1;
+  }
+  outputSettings.basketSize = jSettings.value("BasketSize", 0);
+  if (outputSettings.compactHits && outputFormat == OutputFormat::RNTuple) {
+    std::cerr << "CompactOutput is only for the TTree output format."
+              << std::endl;
+    return 1;
+  }
+  // Optional key: all threads write one file, events_t0.root
+  bool singleOutputFile = jSettings.value("SingleOutputFile", false);
+  if (singleOutputFile && outputFormat == OutputFormat::RNTuple) {
+    std::cerr << "SingleOutputFile is only for the TTree output format."
+              << std::endl;
+    return 1;
+  }
+  // Optional key: files loaded ahead by each thread, 0: no read ahead
+  uint32_t fileReadAheadDepth = jSettings.value("FileReadAheadDepth", 1);
+  // Optional key: MB for the hits and events held by all threads, 0: no limit
+  double_t memoryBudgetMB = jSettings.value("MemoryBudget", 0.);
+  if (memoryBudgetMB < 0.) {
+    std::cerr << "MemoryBudget must be 0 (no limit) or positive."
+              << std::endl;
+    return 1;
+  }
+  // Optional key: worker processes sharing the files and NumberOfThreads,
+  // 1: all threads in this process
+  uint32_t nProcesses = jSettings.value("NumberOfProcesses", 1);
+  if (nProcesses == 0) {
+    std::cerr << "NumberOfProcesses must be 1 or more." << std::endl;
+    return 1;
+  }
+  if (nProcesses > 1 && runStreamMode) {
+    std::cerr << "NumberOfProcesses is not for the run-stream mode."
+              << std::endl;
+    return 1;
+  }
+  // Optional keys: trigger channel of --align and its ADC gate for the
+  // channels other than Si
+  std::vector<uint32_t> alignReference =
+      jSettings.value("AlignReference", std::vector<uint32_t>{2, 0});
+  std::vector<uint16_t> alignTriggerADC =
+      jSettings.value("AlignTriggerADC", std::vector<uint16_t>{0, 0xFFFF});
+  if (alignMode) {
+    if (alignReference.size() != 2 || alignTriggerADC.size() != 2) {
+      std::cerr << "AlignReference is [module, channel] and AlignTriggerADC "
+                   "is [min, max]."
+                << std::endl;
+      return 1;
+    }
+    if (runStreamMode || nProcesses > 1 || coordinatorDirectory != "") {
+      std::cerr << "--align is not for the run-stream, process or campaign "
+                   "mode."
+                << std::endl;
+      return 1;
+    }
+    // The alignment needs the sorted hits of whole files
+    streamingMode = false;
+  }
+
   if (interactionMode) {
     // File specification
     std::cout << "Input the directory: ";
@@ -220,6 +514,38 @@ int main(int argc, char *argv[])
   std::cout << "Start version: " << startVersion << std::endl;
   std::cout << "End version: " << endVersion << std::endl;
   std::cout << "Time window: +-" << timeWindow << " ns" << std::endl;
+  std::cout << "Overlap policy: " << overlapPolicyName << std::endl;
+  std::cout << "Output format: " << outputFormatName
+            << (outputSettings.compactHits ? ", compact hits" : "")
+            << ", compression " << compressionAlgorithm << std::endl;
+  if (memoryBudgetMB > 0.) {
+    std::cout << "Memory budget: " << memoryBudgetMB << " MB" << std::endl;
+  }
+  if (nProcesses > 1) {
+    std::cout << "Worker processes: " << nProcesses << std::endl;
+  }
+  if (runStreamMode) {
+    std::cout << "Run-stream mode: chunk size " << chunkSize
+              << " hits, max time disorder " << maxTimeDisorder
+              << " ns, read ahead " << readAheadDepth << " chunks"
+              << std::endl;
+  } else if (streamingMode) {
+    std::cout << "Streaming mode: chunk size " << chunkSize
+              << " hits, max time disorder " << maxTimeDisorder << " ns"
+              << std::endl;
+  }
+  if (alignMode) {
+    std::cout << "Time alignment: reference module " << alignReference[0]
+              << " channel " << alignReference[1] << ", trigger ADC "
+              << alignTriggerADC[0] << " - " << alignTriggerADC[1]
+              << std::endl;
+  }
+
+  if (coordinatorDirectory != "") {
+    return RunCampaign(coordinatorDirectory, jSettings, directory,
+                       chSettingFileName, runNumber, startVersion, endVersion,
+                       executable);
+  }
 
   auto fileList = GetFileList(directory, runNumber, startVersion, endVersion);
   // for (const auto &file : fileList) {
@@ -230,10 +556,6 @@ int main(int argc, char *argv[])
     std::cerr << "No files found." << std::endl;
     return 1;
   }
-  if (fileList.size() < nThreads) {
-    nThreads = fileList.size();
-    std::cout << "Number of threads: " << nThreads << std::endl;
-  }
 
   auto chSettingsVec = TChSettings::GetChSettings(chSettingFileName);
   if (chSettingsVec.size() == 0) {
@@ -241,61 +563,285 @@ int main(int argc, char *argv[])
               << std::endl;
     return 1;
   }
+  if (outputSettings.compactHits &&
+      chSettingsVec.size() > TOutputSettings::kMaxCompactModules) {
+    std::cerr << "CompactOutput is for up to "
+              << TOutputSettings::kMaxCompactModules << " modules, "
+              << chSettingsVec.size() << " in " << chSettingFileName
+              << std::endl;
+    return 1;
+  }
+
+  // Process mode: the files are shared out largest first, each to the worker
+  // process with the fewest hits so far (then the fewest files: the files
+  // without hits are dealt round-robin).  Every worker runs the code below on
+  // its files with its share of the threads and of the memory budget, writes
+  // its own output files events_t<process>_<thread>.root (found by the
+  // analysis as the events_t* files) and its log to events_p*_log.txt.
+  // Forked before any thread is started.
+  std::string outputPrefix = "events_t";
+  std::unique_ptr<TProcessPool> processPool;
+  bool fileListSorted = false;
+  if (nProcesses > 1) {
+    auto start = std::chrono::high_resolution_clock::now();
+    nProcesses = std::min<uint32_t>(nProcesses, fileList.size());
+    auto nFileHits = SortFileList(fileList);
+    std::vector<std::vector<std::string>> processFiles(nProcesses);
+    std::vector<Long64_t> processHits(nProcesses, 0);
+    for (size_t i = 0; i < fileList.size(); i++) {
+      uint32_t least = 0;
+      for (uint32_t k = 1; k < nProcesses; k++) {
+        if (std::make_pair(processHits[k], processFiles[k].size()) <
+            std::make_pair(processHits[least], processFiles[least].size())) {
+          least = k;
+        }
+      }
+      processFiles[least].push_back(fileList[i]);
+      processHits[least] += nFileHits[i];
+    }
+
+    processPool = std::make_unique<TProcessPool>(nProcesses);
+    const auto worker = processPool->Fork();
+    if (!processPool->IsWorker()) {
+      return RunCoordinator(*processPool, fileList.size(), singleOutputFile,
+                            outputSettings.compression, start);
+    }
+    fileList = processFiles[worker];
+    fileListSorted = true;
+    nThreads = std::max(nThreads / nProcesses, 1u);
+    memoryBudgetMB /= nProcesses;
+    outputPrefix = "events_t" + std::to_string(worker) + "_";
+    auto logName = "events_p" + std::to_string(worker) + "_log.txt";
+    if (!std::freopen(logName.c_str(), "w", stdout)) {
+      std::cerr << "Cannot write " << logName << std::endl;
+    }
+    std::cout << "Worker process " << worker << ": " << fileList.size()
+              << " files, " << nThreads << " threads" << std::endl;
+    if (fileList.size() == 0) {
+      std::cout << "No file for this process" << std::endl;
+      return 0;
+    }
+  }
+
+  // With fewer files than threads, the threads left over build the events of
+  // each file in parallel
+  uint32_t nBuildThreads = 1;
+  if (fileList.size() < nThreads && !runStreamMode) {
+    nBuildThreads = nThreads / fileList.size();
+    nThreads = fileList.size();
+    std::cout << "Number of threads: " << nThreads << std::endl;
+    std::cout << "Event building threads per file: " << nBuildThreads
+              << std::endl;
+  }
 
   ROOT::EnableThreadSafety();
-  std::vector<std::thread> threads;
-  std::mutex mutex;
-  auto eveCount = 0;
+
+  // Shared by the readers, builders and writers of all threads
+  TMemoryBudget memoryBudget(memoryBudgetMB * 1024 * 1024);
+
+  if (runStreamMode) {
+    // The versions are decoded in order by the reader thread, while the
+    // builder works on the chunks already read.  Hits close to a file
+    // boundary stay in the reorder buffer until the next file is merged.
+    auto start = std::chrono::high_resolution_clock::now();
+    THitReader reader(fileList, chSettingsVec, chunkSize, readAheadDepth);
+    reader.SetMemoryBudget(&memoryBudget);
+    reader.Start();
+
+    auto outputName = "events_t0.root";
+    TEventBatchPool batchPool;
+    auto fileWriter = std::make_unique<TFileWriter>(outputName, outputFormat,
+                                                    outputSettings);
+    fileWriter->SetBatchPool(&batchPool);
+    fileWriter->SetMemoryBudget(&memoryBudget);
+    std::cout << "Output file: " << outputName << std::endl;
+
+    TEventBuilder eventBuilder("run" + std::to_string(runNumber), timeWindow,
+                               onlyFissionEvents, chSettingsVec);
+    eventBuilder.SetMaxTimeDisorder(maxTimeDisorder);
+    eventBuilder.SetOverlapPolicy(overlapPolicy);
+    eventBuilder.SetBatchPool(&batchPool);
+    eventBuilder.SetMemoryBudget(&memoryBudget);
+    auto nEvents = eventBuilder.StreamBuild(
+        reader, [&](std::unique_ptr<TEventBatch> &eventData) {
+          fileWriter->SetData(eventData);
+        });
+    fileWriter->Write();
+
+    std::cout << "Number of hits: " << reader.GetNHits() << std::endl;
+    std::cout << "Number of events: " << nEvents << std::endl;
+    if (reader.GetNShrunkChunks() > 0) {
+      std::cout << "Chunks made smaller for memory: "
+                << reader.GetNShrunkChunks() << std::endl;
+    }
+    memoryBudget.PrintStats();
+    auto end = std::chrono::high_resolution_clock::now();
+    auto elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+            .count();
+    std::cout << "Elapsed time: " << elapsed / 1.e3 << " s" << std::endl;
+
+    return 0;
+  }
+
+  // The files are dispatched largest first, so that the last ones to finish
+  // are small.  Each worker writes its own output file.
   auto start = std::chrono::high_resolution_clock::now();
-  for (auto i = 0; i < nThreads; i++) {
-    threads.push_back(std::thread([&, threadID = i]() {
-      mutex.lock();
-      auto outputName = "events_t" + std::to_string(threadID) + ".root";
-      auto fileWriter = std::make_unique<TFileWriter>(outputName);
+  if (!fileListSorted) {
+    SortFileList(fileList);
+  }
+
+  // Time alignment: no event is built or written
+  std::unique_ptr<TTimeAligner> aligner;
+  if (alignMode) {
+    aligner = std::make_unique<TTimeAligner>(
+        chSettingsVec, alignReference[0], alignReference[1], timeWindow,
+        nThreads);
+    aligner->SetTriggerADCRange(alignTriggerADC[0], alignTriggerADC[1]);
+  }
+
+  // Event batches (and their memory) go back from the writers to the builders
+  TEventBatchPool batchPool(2 * nThreads);
+  std::vector<std::unique_ptr<TFileWriter>> fileWriters;
+  std::shared_ptr<ROOT::TBufferMerger> merger;
+  std::vector<std::string> outputNames;
+  if (singleOutputFile && !aligner) {
+    // The baskets of the branches are compressed in parallel (implicit MT)
+    ROOT::EnableImplicitMT(nThreads * nBuildThreads);
+    auto outputName = outputPrefix + "0.root";
+    if (outputSettings.compression >= 0) {
+      merger = std::make_shared<ROOT::TBufferMerger>(
+          outputName.c_str(), "RECREATE", outputSettings.compression);
+    } else {
+      merger = std::make_shared<ROOT::TBufferMerger>(outputName.c_str());
+    }
+    std::cout << "Output file: " << outputName << std::endl;
+    outputNames.push_back(outputName);
+  }
+  for (uint32_t i = 0; i < nThreads && !aligner; i++) {
+    if (merger) {
+      fileWriters.push_back(
+          std::make_unique<TFileWriter>(merger, outputSettings));
+    } else {
+      auto outputName = outputPrefix + std::to_string(i) + ".root";
+      fileWriters.push_back(
+          std::make_unique<TFileWriter>(outputName, outputFormat,
+                                        outputSettings));
       std::cout << "Output file: " << outputName << std::endl;
-      mutex.unlock();
+      outputNames.push_back(outputName);
+    }
+    fileWriters.back()->SetBatchPool(&batchPool);
+    fileWriters.back()->SetMemoryBudget(&memoryBudget);
+  }
 
-      while (true) {
-        mutex.lock();
-        if (fileList.size() == 0) {
-          mutex.unlock();
-          break;
-        }
-        auto fileName = fileList.at(0);
-        fileList.erase(fileList.begin());
-        mutex.unlock();
-
-        TEventBuilder eventBuilder(fileName, timeWindow, onlyFissionEvents,
-                                   chSettingsVec);
-        auto nHits = eventBuilder.LoadHits();
-        mutex.lock();
-        std::cout << "Number of hits from " << fileName << " : " << nHits
-                  << std::endl;
-        mutex.unlock();
+  auto newEventBuilder = [&](const std::string &fileName) {
+    auto eventBuilder = std::make_unique<TEventBuilder>(
+        fileName, timeWindow, onlyFissionEvents, chSettingsVec);
+    eventBuilder->SetOverlapPolicy(overlapPolicy);
+    eventBuilder->SetNThreads(nBuildThreads);
+    eventBuilder->SetBatchPool(&batchPool);
+    eventBuilder->SetMemoryBudget(&memoryBudget);
+    return eventBuilder;
+  };
+  // The next files of a worker are loaded while it builds the current one
+  THitPrefetcher prefetcher(
+      [&](uint32_t iFile) { return newEventBuilder(fileList[iFile]); });
 
-        auto nEvents = eventBuilder.EventBuild();
-        auto eventData = eventBuilder.GetEventData();
-        mutex.lock();
-        std::cout << "Number of events from " << fileName << " : " << nEvents
-                  << std::endl;
-        eveCount += nEvents;
-        fileWriter->SetData(eventData);
-        mutex.unlock();
+  std::mutex mutex;
+  auto eveCount = 0;
+  TWorkStealingPool pool(nThreads);
+  pool.Run(fileList.size(), [&](uint32_t iFile, uint32_t worker) {
+    const auto &fileName = fileList[iFile];
+
+    if (streamingMode) {
+      auto &fileWriter = fileWriters[worker];
+      auto eventBuilder = newEventBuilder(fileName);
+      eventBuilder->SetChunkSize(chunkSize);
+      eventBuilder->SetMaxTimeDisorder(maxTimeDisorder);
+      eventBuilder->SetReadAheadDepth(readAheadDepth);
+      auto nEvents = eventBuilder->StreamBuild(
+          [&](std::unique_ptr<TEventBatch> &eventData) {
+            fileWriter->SetData(eventData);
+          });
+      std::lock_guard<std::mutex> lock(mutex);
+      std::cout << "Number of events from " << fileName << " : " << nEvents
+                << std::endl;
+      eveCount += nEvents;
+      if (processPool) {
+        processPool->Report("file 0 " + std::to_string(nEvents) + " " +
+                            fileName);
       }
-      mutex.lock();
-      std::cout << "Thread " << threadID << " finished." << std::endl;
-      mutex.unlock();
+      return;
+    }
+
+    for (auto next : pool.PeekTasks(worker, fileReadAheadDepth)) {
+      prefetcher.Prefetch(next);
+    }
+    uint32_t nHits = 0;
+    auto eventBuilder = prefetcher.Get(iFile, nHits);
+    mutex.lock();
+    std::cout << "Number of hits from " << fileName << " : " << nHits
+              << std::endl;
+    mutex.unlock();
+
+    if (aligner) {
+      aligner->Fill(eventBuilder->GetHitData(), worker);
+      return;
+    }
+
+    auto nEvents = eventBuilder->EventBuild();
+    auto eventData = eventBuilder->GetEventData();
+    fileWriters[worker]->SetData(eventData);
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << "Number of events from " << fileName << " : " << nEvents
+              << std::endl;
+    eveCount += nEvents;
+    if (processPool) {
+      processPool->Report("file " + std::to_string(nHits) + " " +
+                          std::to_string(nEvents) + " " + fileName);
+    }
+  });
+  pool.PrintStats();
+  if (!streamingMode) {
+    prefetcher.PrintStats();
+  }
 
-      fileWriter->Write();
-    }));
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  if (aligner) {
+    auto nAligned = aligner->Align(chSettingsVec);
+    aligner->Write("time_alignment.root");
+    std::cout << "Aligned channels: " << nAligned << std::endl;
+    std::cout << "Histograms: time_alignment.root" << std::endl;
+    if (!TTimeAligner::WriteTimeOffsets(chSettingFileName, chSettingsVec)) {
+      return 1;
+    }
+    std::cout << "Time offsets written to " << chSettingFileName << std::endl;
+    memoryBudget.PrintStats();
+    auto end = std::chrono::high_resolution_clock::now();
+    auto elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+            .count();
+    std::cout << "Elapsed time: " << elapsed / 1.e3 << " s" << std::endl;
+
+    return (nAligned > 0) ? 0 : 1;
   }
 
-  for (auto &thread : threads) {
-    thread.join();
+  // The writers close their files in parallel
+  TWorkStealingPool writePool(nThreads);
+  writePool.Run(nThreads, [&](uint32_t iWriter, uint32_t) {
+    fileWriters[iWriter]->Write();
+  });
+  fileWriters.clear();
+  merger.reset();  // writes the single output file
+  if (processPool) {
+    // Written and closed: the coordinator can merge them
+    for (const auto &outputName : outputNames) {
+      processPool->Report("output " + outputName);
+    }
   }
+
   // fileWriter->Write();
   std::cout << "Number of events: " << eveCount << std::endl;
+  memoryBudget.PrintStats();
   auto end = std::chrono::high_resolution_clock::now();
   auto elapsed =
       std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
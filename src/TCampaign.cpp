@@ -0,0 +1,404 @@
+#include "TCampaign.hpp"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+static const std::string kTakenSuffix = ".taken";
+
+static double_t Since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double_t>(std::chrono::steady_clock::now() -
+                                         start)
+      .count();
+}
+
+static void Sleep(double_t seconds)
+{
+  std::this_thread::sleep_for(std::chrono::duration<double_t>(seconds));
+}
+
+TCampaign::TCampaign(const std::string &directory) : fDirectory(directory)
+{
+  char host[256] = "";
+  gethostname(host, sizeof(host) - 1);
+  fHost = host;
+}
+
+bool TCampaign::WriteJson(const fs::path &path, const nlohmann::json &j)
+{
+  // Written aside and renamed: the others never see a partial file
+  auto tmp = path;
+  tmp += ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream file(tmp);
+    if (!file.is_open()) {
+      std::cerr << "Cannot write " << tmp << std::endl;
+      return false;
+    }
+    file << j.dump(2) << std::endl;
+  }
+  std::error_code error;
+  fs::rename(tmp, path, error);
+  if (error) {
+    std::cerr << "Cannot write " << path << ": " << error.message()
+              << std::endl;
+    fs::remove(tmp, error);
+    return false;
+  }
+  return true;
+}
+
+bool TCampaign::ReadJson(const fs::path &path, nlohmann::json &j)
+{
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+  j = nlohmann::json::parse(file, nullptr, false);
+  return !j.is_discarded();
+}
+
+uint32_t TCampaign::CountUnits(const fs::path &directory)
+{
+  uint32_t n = 0;
+  std::error_code error;
+  for (const auto &entry : fs::directory_iterator(directory, error)) {
+    const auto name = entry.path().filename().string();
+    if (name.find(".json") != std::string::npos &&
+        name.find(".tmp.") == std::string::npos) {
+      n++;
+    }
+  }
+  return n;
+}
+
+bool TCampaign::Create(const nlohmann::json &settings,
+                       const std::vector<TWorkUnit> &units)
+{
+  if (fs::exists(fDirectory / "settings.json")) {
+    std::cerr << "A campaign is already in " << fDirectory
+              << ", resuming it." << std::endl;
+    return false;
+  }
+  for (auto sub : {"todo", "running", "done", "failed", "out"}) {
+    std::error_code error;
+    fs::create_directories(fDirectory / sub, error);
+    if (error) {
+      std::cerr << "Cannot create " << fDirectory / sub << ": "
+                << error.message() << std::endl;
+      return false;
+    }
+  }
+  if (!WriteJson(fDirectory / "settings.json", settings)) {
+    return false;
+  }
+  for (const auto &unit : units) {
+    WriteJson(fDirectory / "todo" / (unit.GetName() + ".json"),
+              unit.ToJson());
+  }
+  std::cout << "Campaign in " << fDirectory << ": " << units.size()
+            << " units" << std::endl;
+  return true;
+}
+
+uint32_t TCampaign::Coordinate(double_t leaseTimeout)
+{
+  nlohmann::json settings;
+  if (!ReadJson(fDirectory / "settings.json", settings)) {
+    std::cerr << "No campaign in " << fDirectory << std::endl;
+    return 1;
+  }
+  fMaxRetries = settings.value("MaxRetries", 2);
+
+  std::string last;
+  while (true) {
+    ExpireLeases(leaseTimeout);
+    const auto nTodo = CountUnits(fDirectory / "todo");
+    const auto nRunning = CountUnits(fDirectory / "running");
+    const auto status =
+        "Units: " + std::to_string(nTodo) + " waiting, " +
+        std::to_string(nRunning) + " running, " +
+        std::to_string(CountUnits(fDirectory / "done")) + " done, " +
+        std::to_string(CountUnits(fDirectory / "failed")) + " failed";
+    if (status != last) {
+      std::cout << status << std::endl;
+      last = status;
+    }
+    if (nTodo == 0 && nRunning == 0) break;
+    Sleep(kPollInterval);
+  }
+
+  WriteManifest();
+  return CountUnits(fDirectory / "failed");
+}
+
+void TCampaign::ExpireLeases(double_t leaseTimeout)
+{
+  std::error_code error;
+  // A unit put back while its worker was only slow can be done twice
+  for (const auto &entry : fs::directory_iterator(fDirectory / "todo", error)) {
+    if (fs::exists(fDirectory / "done" / entry.path().filename())) {
+      fs::remove(entry.path(), error);
+    }
+  }
+
+  const auto now = fs::file_time_type::clock::now();
+  std::vector<fs::path> leases;
+  for (const auto &entry :
+       fs::directory_iterator(fDirectory / "running", error)) {
+    std::error_code timeError;
+    const auto touched = fs::last_write_time(entry.path(), timeError);
+    if (timeError) continue;
+    const auto age = std::chrono::duration<double_t>(now - touched).count();
+    if (age >= leaseTimeout) leases.push_back(entry.path());
+  }
+
+  for (const auto &lease : leases) {
+    const auto name = lease.filename().string();
+    nlohmann::json j;
+    if (name.find(".tmp.") != std::string::npos || !ReadJson(lease, j)) {
+      continue;
+    }
+    const auto unit = TWorkUnit::FromJson(j);
+    auto taken = lease;
+    std::error_code removeError;
+    if (name.size() > kTakenSuffix.size() &&
+        name.compare(name.size() - kTakenSuffix.size(), kTakenSuffix.size(),
+                     kTakenSuffix) == 0) {
+      // Its taker stopped before the unit was put anywhere
+      if (fs::exists(fDirectory / "done" / (unit.GetName() + ".json"))) {
+        fs::remove(lease, removeError);
+        continue;
+      }
+    } else if (!TakeLease(lease, taken)) {
+      continue;  // the worker ends it
+    }
+    auto report = j;
+    report["Expired"] = name;
+    std::cout << "Lease expired: " << name << std::endl;
+    if (Requeue(unit, report)) {
+      fs::remove(taken, removeError);
+    }
+  }
+}
+
+bool TCampaign::TakeLease(const fs::path &lease, fs::path &taken)
+{
+  taken = lease;
+  taken += kTakenSuffix;
+  std::error_code error;
+  fs::rename(lease, taken, error);
+  if (error) return false;
+  // The rename keeps the time of the last heartbeat
+  fs::last_write_time(taken, fs::file_time_type::clock::now(), error);
+  return true;
+}
+
+bool TCampaign::Requeue(TWorkUnit unit, const nlohmann::json &report)
+{
+  unit.attempts++;
+  const auto fileName = unit.GetName() + ".json";
+  if (unit.attempts > fMaxRetries) {
+    auto failed = report;
+    failed["Attempts"] = unit.attempts;
+    std::cerr << "Unit failed: " << unit.GetName() << std::endl;
+    return WriteJson(fDirectory / "failed" / fileName, failed);
+  }
+  return WriteJson(fDirectory / "todo" / fileName, unit.ToJson());
+}
+
+bool TCampaign::Claim(TWorkUnit &unit, fs::path &lease, std::string &attempt)
+{
+  std::error_code error;
+  for (const auto &entry : fs::directory_iterator(fDirectory / "todo", error)) {
+    const auto name = entry.path().filename().string();
+    if (entry.path().extension() != ".json") continue;
+    attempt = fHost + "." + std::to_string(getpid()) + "." +
+              std::to_string(fNClaims);
+    lease = fDirectory / "running" / (name + "." + attempt);
+    // The rename is atomic: one worker gets the unit
+    std::error_code renameError;
+    fs::rename(entry.path(), lease, renameError);
+    if (renameError) continue;
+    // The rename keeps the time of the todo file, which can be older than
+    // the lease timeout: the lease starts now
+    fs::last_write_time(lease, fs::file_time_type::clock::now(), renameError);
+    nlohmann::json j;
+    if (!ReadJson(lease, j)) {
+      std::cerr << "Unreadable unit " << name << std::endl;
+      fs::rename(lease, fDirectory / "failed" / name, renameError);
+      continue;
+    }
+    unit = TWorkUnit::FromJson(j);
+    fNClaims++;
+    return true;
+  }
+  return false;
+}
+
+int32_t TCampaign::Build(const TWorkUnit &unit, const fs::path &lease,
+                         const std::string &attempt,
+                         const std::string &executable)
+{
+  // Own directory: a worker whose lease expired can still be writing its
+  // attempt
+  const auto outDirectory = GetOutputDirectory(unit, attempt);
+  std::error_code error;
+  fs::create_directories(outDirectory, error);
+
+  nlohmann::json settings;
+  ReadJson(fDirectory / "settings.json", settings);
+  settings["RunNumber"] = unit.runNumber;
+  settings["StartVersion"] = unit.startVersion;
+  settings["EndVersion"] = unit.endVersion;
+  if (!WriteJson(outDirectory / "settings.json", settings)) {
+    return 1;
+  }
+
+  std::cout.flush();
+  const auto pid = fork();
+  if (pid < 0) {
+    std::cerr << "Cannot fork: " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+  if (pid == 0) {
+    if (chdir(outDirectory.c_str()) != 0 ||
+        !std::freopen("log.txt", "w", stdout)) {
+      _exit(126);
+    }
+    dup2(fileno(stdout), STDERR_FILENO);
+    execl(executable.c_str(), executable.c_str(), "-b", "settings.json",
+          static_cast<char *>(nullptr));
+    _exit(127);
+  }
+
+  int status = 0;
+  auto heartbeat = std::chrono::steady_clock::now();
+  while (true) {
+    const auto done = waitpid(pid, &status, WNOHANG);
+    if (done == pid || (done < 0 && errno != EINTR)) break;
+    if (Since(heartbeat) > kHeartbeatInterval) {
+      fs::last_write_time(lease, fs::file_time_type::clock::now(), error);
+      heartbeat = std::chrono::steady_clock::now();
+    }
+    Sleep(1.);
+  }
+  if (WIFEXITED(status)) return WEXITSTATUS(status);
+  if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+  return 1;
+}
+
+uint32_t TCampaign::Work(const std::string &executable)
+{
+  nlohmann::json settings;
+  if (!ReadJson(fDirectory / "settings.json", settings)) {
+    std::cerr << "No campaign in " << fDirectory << std::endl;
+    return 1;
+  }
+  fMaxRetries = settings.value("MaxRetries", 2);
+
+  uint32_t nFailed = 0;
+  while (true) {
+    TWorkUnit unit;
+    fs::path lease;
+    std::string attempt;
+    if (!Claim(unit, lease, attempt)) {
+      // Units still running elsewhere can come back
+      if (CountUnits(fDirectory / "todo") == 0 &&
+          CountUnits(fDirectory / "running") == 0) {
+        break;
+      }
+      Sleep(kPollInterval);
+      continue;
+    }
+
+    std::cout << "Unit " << unit.GetName() << " on " << fHost << std::endl;
+    const auto start = std::chrono::steady_clock::now();
+    const auto exitCode = Build(unit, lease, attempt, executable);
+    const auto outDirectory = GetOutputDirectory(unit, attempt);
+    auto report = unit.ToJson();
+    report["Host"] = fHost;
+    report["ExitCode"] = exitCode;
+    report["ElapsedTime"] = Since(start);
+    report["OutputDirectory"] = outDirectory.string();
+
+    std::error_code error;
+    fs::path taken;
+    if (!TakeLease(lease, taken)) {
+      // Expired and put back by the coordinator: another attempt owns it
+      std::cerr << "Lease of unit " << unit.GetName()
+                << " expired, result dropped" << std::endl;
+      fs::remove_all(outDirectory, error);
+      continue;
+    }
+    if (exitCode != 0) {
+      std::cerr << "Unit " << unit.GetName() << " exited with " << exitCode
+                << std::endl;
+      nFailed++;
+      if (Requeue(unit, report)) {
+        fs::remove(taken, error);
+      }
+      continue;
+    }
+
+    report["OutputFiles"] = nlohmann::json::array();
+    for (const auto &entry : fs::directory_iterator(outDirectory, error)) {
+      if (entry.path().extension() != ".root") continue;
+      report["OutputFiles"].push_back(
+          {{"Name", entry.path().string()},
+           {"Size", fs::file_size(entry.path(), error)}});
+    }
+    std::ifstream log(outDirectory / "log.txt");
+    const std::string key = "Number of events: ";
+    for (std::string line; std::getline(log, line);) {
+      if (line.compare(0, key.size(), key) == 0) {
+        report["NumberOfEvents"] = std::stoull(line.substr(key.size()));
+      }
+    }
+    if (!WriteJson(fDirectory / "done" / (unit.GetName() + ".json"),
+                   report)) {
+      continue;  // the coordinator puts the taken lease back when it expires
+    }
+    fs::remove(taken, error);
+    std::cout << "Unit " << unit.GetName() << " done in "
+              << report["ElapsedTime"].get<double_t>() << " s" << std::endl;
+  }
+  return nFailed;
+}
+
+void TCampaign::WriteManifest()
+{
+  nlohmann::json manifest;
+  manifest["Done"] = nlohmann::json::array();
+  manifest["Failed"] = nlohmann::json::array();
+  uint64_t nEvents = 0;
+  std::error_code error;
+  for (auto sub : {"Done", "Failed"}) {
+    auto directory = fDirectory / (sub == std::string("Done") ? "done"
+                                                              : "failed");
+    for (const auto &entry : fs::directory_iterator(directory, error)) {
+      nlohmann::json j;
+      if (entry.path().extension() != ".json" || !ReadJson(entry.path(), j)) {
+        continue;
+      }
+      nEvents += j.value("NumberOfEvents", uint64_t(0));
+      manifest[sub].push_back(j);
+    }
+  }
+  manifest["NumberOfEvents"] = nEvents;
+  WriteJson(fDirectory / "manifest.json", manifest);
+  std::cout << "Manifest: " << fDirectory / "manifest.json" << ", "
+            << manifest["Done"].size() << " units done, "
+            << manifest["Failed"].size() << " failed, " << nEvents
+            << " events" << std::endl;
+}
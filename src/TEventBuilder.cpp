@@ -5,247 +5,642 @@
 
 #include <algorithm>
 #include <iostream>
+#include <limits>
+
+#include "TWorkStealingPool.hpp"
+
+// Smallest time slice of the parallel event building
+static constexpr int32_t kMinSliceHits = 100000;
+// Memory of one hit while loading: the hit and its copy in the sort buffer,
+// and the index arrays of the sort (grouped, merged and final order)
+static constexpr size_t kLoadBytesPerHit =
+    2 * THitBuffer::kBytesPerHit + 3 * sizeof(uint32_t);
 
 TEventBuilder::TEventBuilder(
     const std::string &fileName, const double_t timeWindow,
     bool onlyFissionEvents,
     const std::vector<std::vector<TChSettings>> &settings)
     : fFileName(fileName),
-      fTimeWindow(timeWindow),
+      fTimeWindow(NsToPs(timeWindow)),
       fOnlyFissionEvents(onlyFissionEvents),
-      fSettings(settings)
+      fSettings(settings),
+      fChannelTable(settings)
 {
 }
 
 TEventBuilder::~TEventBuilder() {}
 
-uint32_t TEventBuilder::LoadHits()
+uint32_t TEventBuilder::LoadHits(bool waitForMemory)
 {
-  fHitData.clear();
+  fHitData.Clear();
+  fNUnknownChannelHits = 0;
+  fLoadDeferred = false;
 
-  auto file = TFile::Open(fFileName.c_str(), "READ");
-  if (!file) {
-    std::cout << "File not found: " << fFileName << std::endl;
-    return 0;
-  }
-  auto tree = dynamic_cast<TTree *>(file->Get("ELIADE_Tree"));
+  TFile *file = nullptr;
+  HitData_t hit;
+  auto tree = THitReader::OpenHitTree(fFileName, file, hit);
   if (!tree) {
-    std::cout << "Tree not found: " << fFileName << std::endl;
-    file->Close();
-    delete file;
     return 0;
   }
-  tree->SetBranchStatus("*", kFALSE);
-
-  HitData_t hit;
-
-  tree->SetBranchStatus("Ch", kTRUE);
-  tree->SetBranchAddress("Ch", &hit.Channel);
-
-  tree->SetBranchStatus("Mod", kTRUE);
-  tree->SetBranchAddress("Mod", &hit.Module);
-
-  tree->SetBranchStatus("FineTS", kTRUE);
-  tree->SetBranchAddress("FineTS", &hit.Timestamp);
-
-  tree->SetBranchStatus("ChargeLong", kTRUE);
-  tree->SetBranchAddress("ChargeLong", &hit.Energy);
-
-  tree->SetBranchStatus("ChargeShort", kTRUE);
-  tree->SetBranchAddress("ChargeShort", &hit.EnergyShort);
 
   const auto nEntries = tree->GetEntries();
+  if (fMemoryBudget) {
+    const size_t bytes = nEntries * kLoadBytesPerHit;
+    fHitReservation.Release();
+    if (waitForMemory) {
+      fHitReservation = fMemoryBudget->Reserve(MemoryStage::Loader, bytes);
+    } else {
+      fHitReservation = fMemoryBudget->TryReserve(MemoryStage::Loader, bytes);
+      if (!fHitReservation.IsValid()) {
+        file->Close();
+        fLoadDeferred = true;
+        return 0;
+      }
+    }
+  }
+  fHitData.Reserve(nEntries);
   for (auto i = 0; i < nEntries; i++) {
     tree->GetEntry(i);
-    hit.Timestamp /= 1000.0;  // ps -> ns
-    hit.Timestamp += fSettings.at(hit.Module).at(hit.Channel).timeOffset;
-    fHitData.push_back(hit);
+    if (!fChannelTable.Contains(hit.Module, hit.Channel)) {
+      fNUnknownChannelHits++;
+      continue;
+    }
+    fHitData.PushBack(
+        hit, std::llround(hit.Timestamp) +
+                 fChannelTable.Get(hit.Module, hit.Channel).timeOffset);
   }
 
-  CheckHitData();
-
   file->Close();
 
-  return fHitData.size();
+  if (fHitData.Size() > 0 &&
+      THitReader::CheckTimeRange(fFileName, fHitData.Timestamp.front(),
+                                 fHitData.Timestamp.back())) {
+    SortHitData(0);
+  } else {
+    fHitData.Clear();
+  }
+  fSortBuffer.Clear();
+  fSortBuffer.ShrinkToFit();
+  fSorter.ShrinkToFit();
+  fHitReservation.Resize(fHitData.GetMemorySize());
+
+  return fHitData.Size();
 }
 
-void TEventBuilder::CheckHitData()
+void TEventBuilder::SetHitData(const THitBuffer &hits)
 {
-  const double_t timeOffset = (pow(2, 47) - 1);
-  const auto firstTS = fHitData.at(0).Timestamp;
-  const auto lastTS = fHitData.at(fHitData.size() - 1).Timestamp;
-  const auto duration = lastTS - firstTS;
+  fHitData = hits;
+  fNUnknownChannelHits = 0;
+  SortHitData(0);
+  fSortBuffer.Clear();
+  fSortBuffer.ShrinkToFit();
+  fSorter.ShrinkToFit();
+}
 
-  if (duration > timeOffset / 4) {
-    std::cout << "Rejected: " << fFileName << std::endl;
-    fHitData.clear();
-    return;
+// Counts the memory now used by a stage, without waiting: it is allocated
+void TEventBuilder::ChargeMemory(TMemoryReservation &reservation,
+                                 MemoryStage_t stage, size_t bytes)
+{
+  if (!fMemoryBudget) return;
+  if (reservation.IsValid()) {
+    reservation.Resize(bytes);
   } else {
-    if (duration > timeOffset) {
-      std::cout << "Timestamp overflow detected: " << fFileName;
-      std::cout << "\nFirst timestamp: " << firstTS;
-      std::cout << "\nLast timestamp: " << lastTS << std::endl;
-
-      for (auto i = 0; i < fHitData.size() - 1; i++) {
-        auto originalTS = fHitData.at(i).Timestamp;
-        if (fHitData.at(i).Module == 0 || fHitData.at(i).Module == 1) {
-          fHitData.at(i).Timestamp += timeOffset * 4;
-        } else {
-          fHitData.at(i).Timestamp += timeOffset * 2;
-        }
+    reservation = fMemoryBudget->Charge(stage, bytes);
+  }
+}
 
-        if (fHitData.at(i + 1).Timestamp - originalTS > timeOffset) {
-          break;
-        }
-      }
+// k-way merge of the time ordered streams [activeBegin[i], activeEnd[i]) of
+// grouped.  Equal timestamps are taken in the order of the streams, as the
+// stable sort of grouped does.
+static std::vector<uint32_t> MergeStreams(
+    const std::vector<Timestamp_t> &timestamp,
+    const std::vector<uint32_t> &grouped,
+    const std::vector<uint32_t> &activeBegin,
+    const std::vector<uint32_t> &activeEnd)
+{
+  // Loser tree over the stream heads: every output hit costs log2(K)
+  // comparisons on the path from its leaf to the root.
+  uint32_t nLeaves = 1;
+  while (nLeaves < activeBegin.size()) nLeaves *= 2;
+  std::vector<uint32_t> position(nLeaves, 0);
+  constexpr auto kEndTime = std::numeric_limits<Timestamp_t>::max();
+  std::vector<Timestamp_t> headTime(nLeaves, kEndTime);
+  for (uint32_t i = 0; i < activeBegin.size(); i++) {
+    position[i] = activeBegin[i];
+    headTime[i] = timestamp[grouped[position[i]]];
+  }
+
+  // Node n (1 <= n < nLeaves) keeps the loser of its match.  Build it bottom
+  // up, carrying the winners of the lower level in winner[].
+  std::vector<uint32_t> loser(nLeaves, 0);
+  std::vector<uint32_t> winner(2 * nLeaves);
+  for (uint32_t i = 0; i < nLeaves; i++) winner[nLeaves + i] = i;
+  for (uint32_t n = nLeaves - 1; n > 0; n--) {
+    const auto a = winner[2 * n];
+    const auto b = winner[2 * n + 1];
+    winner[n] = (headTime[b] < headTime[a]) ? b : a;
+    loser[n] = (headTime[b] < headTime[a]) ? a : b;
+  }
+  auto top = winner[1];
+
+  std::vector<uint32_t> merged;
+  merged.reserve(grouped.size());
+  for (size_t iHit = 0; iHit < grouped.size(); iHit++) {
+    auto &pos = position[top];
+    merged.push_back(grouped[pos++]);
+    headTime[top] =
+        (pos < activeEnd[top]) ? timestamp[grouped[pos]] : kEndTime;
+
+    // Replay the matches of the winner's leaf (branch free)
+    auto current = top;
+    for (auto n = (nLeaves + current) / 2; n > 0; n /= 2) {
+      const auto challenger = loser[n];
+      const bool swap = headTime[challenger] < headTime[current] ||
+                        (headTime[challenger] == headTime[current] &&
+                         challenger < current);
+      loser[n] = swap ? current : challenger;
+      current = swap ? challenger : current;
     }
+    top = current;
   }
 
-  std::sort(fHitData.begin(), fHitData.end(),
-            [](const HitData_t &a, const HitData_t &b) {
-              return a.Timestamp < b.Timestamp;
-            });
+  return merged;
 }
 
-HitType_t TEventBuilder::GetHitType(uint8_t module)
+// Sort fHitData by time, the first nSorted hits being already sorted.
+// Each channel is written in time order by the digitizer: the other hits are
+// grouped by channel and combined with a loser tree k-way merge, O(N log K).
+// A channel found out of order is sorted on its own first.  With more than
+// one thread, the grouped hits are radix sorted in parallel instead of the
+// merge, and the channels are only checked.
+void TEventBuilder::SortHitData(size_t nSorted)
 {
-  if (module == 0) {
-    return HitType::SiFront;
-  } else if (module == 1) {
-    return HitType::SiBack;
-  } else if (module >= 2 && module <= 4) {
-    return HitType::Gamma;
-  } else if (module >= 5 && module <= 9) {
-    return HitType::Neutron;
+  const auto &timestamp = fHitData.Timestamp;
+  const size_t nHits = fHitData.Size();
+
+  // Group the new hits by channel, keeping the file order (counting sort)
+  const auto nStreams = fChannelTable.Size();
+  auto stream = [this](size_t i) {
+    return TChannelTable::GetIndex(fHitData.Module[i], fHitData.Channel[i]);
+  };
+  std::vector<uint32_t> streamBegin(nStreams + 1, 0);
+  for (size_t i = nSorted; i < nHits; i++) {
+    streamBegin[stream(i) + 1]++;
+  }
+  for (uint32_t i = 0; i < nStreams; i++) {
+    streamBegin[i + 1] += streamBegin[i];
+  }
+  std::vector<uint32_t> grouped(nHits - nSorted);
+  {
+    auto next = streamBegin;
+    for (size_t i = nSorted; i < nHits; i++) {
+      grouped[next[stream(i)]++] = i;
+    }
+  }
+
+  const auto isParallel =
+      fNThreads > 1 && grouped.size() >= THitSorter::kMinParallelHits;
+  auto isEarlier = [&timestamp](uint32_t a, uint32_t b) {
+    return timestamp[a] < timestamp[b];
+  };
+
+  // Only the channels with hits take part in the merge
+  std::vector<uint32_t> activeBegin;
+  std::vector<uint32_t> activeEnd;
+  fNUnorderedStreams = 0;
+  for (uint32_t i = 0; i < nStreams; i++) {
+    const auto begin = grouped.data() + streamBegin[i];
+    const auto end = grouped.data() + streamBegin[i + 1];
+    if (begin == end) continue;
+    if (isParallel) {
+      // All the grouped hits are sorted below
+      if (!std::is_sorted(begin, end, isEarlier)) fNUnorderedStreams++;
+      continue;
+    }
+    fSorter.Sort(timestamp, begin, end);
+    if (fSorter.GetLastPath() != SortPath::Sorted) {
+      fNUnorderedStreams++;
+    }
+    activeBegin.push_back(streamBegin[i]);
+    activeEnd.push_back(streamBegin[i + 1]);
+  }
+
+  std::vector<uint32_t> merged;
+  if (isParallel) {
+    fSorter.Sort(timestamp, grouped);
+    merged.swap(grouped);
   } else {
-    std::cout << "Unknown module: " << static_cast<int>(module) << std::endl;
-    return HitType::Unknown;
+    merged = MergeStreams(timestamp, grouped, activeBegin, activeEnd);
+  }
+  std::vector<uint32_t>().swap(grouped);
+
+  // Merge with the sorted part (taken first for equal timestamps)
+  std::vector<uint32_t> index;
+  index.reserve(nHits);
+  size_t iOld = 0;
+  auto iNew = merged.begin();
+  while (iOld < nSorted && iNew != merged.end()) {
+    if (timestamp[*iNew] < timestamp[iOld]) {
+      index.push_back(*iNew++);
+    } else {
+      index.push_back(iOld++);
+    }
+  }
+  for (; iOld < nSorted; iOld++) index.push_back(iOld);
+  index.insert(index.end(), iNew, merged.end());
+
+  fSortBuffer.Gather(fHitData, index);
+  fHitData.Swap(fSortBuffer);
+}
+
+void TEventBuilder::UpdateTimeOffsets(
+    const std::vector<std::vector<TChSettings>> &settings)
+{
+  // Adding a constant to one channel keeps the channel in time order, so the
+  // hits only have to be merged again.
+  TChannelTable channelTable(settings);
+  for (size_t i = 0; i < fHitData.Size(); i++) {
+    const auto module = fHitData.Module[i];
+    const auto channel = fHitData.Channel[i];
+    fHitData.Timestamp[i] += channelTable.Get(module, channel).timeOffset -
+                             fChannelTable.Get(module, channel).timeOffset;
   }
-  return HitType::Unknown;
+  fSettings = settings;
+  fChannelTable = channelTable;
+
+  SortHitData(0);
+  fSortBuffer.Clear();
+  fSortBuffer.ShrinkToFit();
+  fSorter.ShrinkToFit();
 }
 
 uint32_t TEventBuilder::EventBuild()
 {
-  if (fHitData.size() == 0) {
+  if (fHitData.Size() == 0) {
     std::cout << "No hits loaded." << std::endl;
     return 0;
   }
 
-  fEventData = std::make_unique<std::vector<TEventData>>();
-
-  const int32_t nHits = fHitData.size();
-  for (auto iHit = 0; iHit < nHits; iHit++) {
-    auto hit = fHitData.at(iHit);
-    if (fSettings.at(hit.Module).at(hit.Channel).isEventTrigger) {
-      TEventData eventData;
-      eventData.IsFissionEvent = false;
-      eventData.SiFrontMultiplicity = 0;
-      eventData.SiBackMultiplicity = 0;
-      eventData.SiMultiplicity = 0;
-      eventData.GammaMultiplicity = 0;
-      eventData.NeutronMultiplicity = 0;
-      eventData.TriggerTime = hit.Timestamp;
-      uint16_t frontADC = 0;
-      uint16_t backADC = 0;
-
-      auto triggerTime = hit.Timestamp;
-      hit.Timestamp -= triggerTime;
-      eventData.HitData.push_back(hit);
-      auto hitType = GetHitType(hit.Module);
+  fEventData = NewEventBatch();
+  fNUnknownTypeHits = 0;
+
+  if (fNThreads > 1 && fHitData.Size() >= 2 * kMinSliceHits) {
+    ParallelBuildEvents();
+  } else {
+    TBuildOutput output;
+    output.eventData = fEventData.get();
+    BuildEvents(0, fHitData.Size(), true, output);
+    fNUnknownTypeHits = output.nUnknownTypeHits;
+  }
+  PrintUnknownHits();
+  ChargeMemory(fEventReservation, MemoryStage::Builder,
+               fEventData->GetMemorySize());
+
+  return fEventData->Size();
+}
+
+void TEventBuilder::PrintUnknownHits()
+{
+  if (fNUnknownChannelHits > 0) {
+    std::cout << "Hits of channels not in the channel settings from "
+              << fFileName << " : " << fNUnknownChannelHits << std::endl;
+  }
+  if (fNUnknownTypeHits > 0) {
+    std::cout << "Hits of unknown DetectorType from " << fFileName << " : "
+              << fNUnknownTypeHits << std::endl;
+  }
+}
+
+// First index in [from, end) with timestamp > time.  Exponential search from
+// from, then binary search: O(log distance) for the short skips of the dead
+// time.
+static int32_t SkipAfter(const std::vector<Timestamp_t> &timestamp,
+                         int32_t from, int32_t end, Timestamp_t time)
+{
+  int32_t step = 1;
+  auto low = from;
+  auto high = from;
+  while (high < end && timestamp[high] <= time) {
+    low = high + 1;
+    high = std::min(end, high + step);
+    step *= 2;
+  }
+  return std::upper_bound(timestamp.begin() + low, timestamp.begin() + high,
+                          time) -
+         timestamp.begin();
+}
+
+// Build the events of the trigger candidates in [start, stop) of fHitData.
+// Returns the index of the next trigger candidate (can be beyond stop because
+// of the dead time after each trigger).
+// The window [lower, upper) of hits only moves forward, each hit enters and
+// leaves it once: O(hits) plus the hits copied into the events.
+int32_t TEventBuilder::BuildEvents(int32_t start, int32_t stop, bool isFinal,
+                                   TBuildOutput &output)
+{
+  const int32_t nHits = fHitData.Size();
+  const auto &timestamp = fHitData.Timestamp;
+  auto &eventData = *output.eventData;
+  auto &eventHits = eventData.Hit;
+  auto isTrigger = [this](int32_t i) {
+    return fChannelTable.Get(fHitData.Module[i], fHitData.Channel[i])
+        .isEventTrigger;
+  };
+
+  int32_t lower = -1;  // first hit with t >= triggerTime - window
+  int32_t upper = 0;   // first hit with t > (last) triggerTime + window
+  auto iHit = start;
+  while (iHit < stop) {
+    if (!isTrigger(iHit)) {
+      iHit++;
+      continue;
+    }
+
+    const auto triggerTime = timestamp[iHit];
+    if (lower < 0) {
+      lower = std::lower_bound(timestamp.begin(), timestamp.begin() + iHit,
+                               triggerTime - fTimeWindow) -
+              timestamp.begin();
+    }
+    for (; timestamp[lower] - triggerTime < -fTimeWindow; lower++);
+    upper = std::max(upper, iHit + 1);
+    for (; upper < nHits && timestamp[upper] - triggerTime <= fTimeWindow;
+         upper++);
+
+    // Triggers whose windows overlap the event one are merged into it
+    auto next = iHit + 1;
+    if (fOverlapPolicy == OverlapPolicy::Merge) {
+      auto lastTriggerTime = triggerTime;
+      for (; next < nHits &&
+             timestamp[next] <= lastTriggerTime + fTimeWindow + fTimeWindow;
+           next++) {
+        if (!isTrigger(next)) continue;
+        if (next >= stop && !isFinal) {
+          // The end of the merged event is not final yet (streaming mode)
+          return iHit;
+        }
+        lastTriggerTime = timestamp[next];
+        for (; upper < nHits &&
+               timestamp[upper] - lastTriggerTime <= fTimeWindow;
+             upper++);
+      }
+    }
+
+    if (output.recordTriggers) {
+      output.triggerIndex.push_back(iHit);
+      output.nEventsBefore.push_back(eventData.Size());
+      output.nUnknownTypeHitsBefore.push_back(output.nUnknownTypeHits);
+    }
+
+    TEventInfo eventInfo;
+    eventInfo.TriggerTime = triggerTime;
+    eventInfo.TriggerID =
+        fChannelTable.Get(fHitData.Module[iHit], fHitData.Channel[iHit])
+            .detectorID;
+    uint16_t frontADC = 0;
+    uint16_t backADC = 0;
+
+    auto addHit = [&](int32_t jHit) {
+      const auto energy = fHitData.Energy[jHit];
+      const auto hitType =
+          fChannelTable.Get(fHitData.Module[jHit], fHitData.Channel[jHit])
+              .hitType;
       if (hitType == HitType::SiFront) {
-        eventData.SiMultiplicity++;
-        eventData.SiFrontMultiplicity++;
-        frontADC = std::max(frontADC, hit.Energy);
+        eventInfo.SiMultiplicity++;
+        eventInfo.SiFrontMultiplicity++;
+        frontADC = std::max(frontADC, energy);
       } else if (hitType == HitType::SiBack) {
-        eventData.SiMultiplicity++;
-        eventData.SiBackMultiplicity++;
-        backADC = std::max(backADC, hit.Energy);
+        eventInfo.SiMultiplicity++;
+        eventInfo.SiBackMultiplicity++;
+        backADC = std::max(backADC, energy);
       } else if (hitType == HitType::Gamma) {
-        eventData.GammaMultiplicity++;
+        eventInfo.GammaMultiplicity++;
       } else if (hitType == HitType::Neutron) {
-        eventData.NeutronMultiplicity++;
+        eventInfo.NeutronMultiplicity++;
+      } else {
+        output.nUnknownTypeHits++;
       }
+      eventHits.PushBack(fHitData, jHit);
+      eventHits.Timestamp.back() -= triggerTime;
+    };
+
+    // Trigger first, then the hits after and before it
+    addHit(iHit);
+    for (auto jHit = iHit + 1; jHit < upper; jHit++) addHit(jHit);
+    for (auto jHit = iHit - 1; jHit >= lower; jHit--) addHit(jHit);
+
+    eventInfo.IsFissionEvent = (eventInfo.SiFrontMultiplicity > 0) &&
+                               (eventInfo.SiBackMultiplicity > 0) &&
+                               (frontADC > 1500.0) && (backADC > 1500.0);
+
+    if (fOnlyFissionEvents && !eventInfo.IsFissionEvent) {
+      eventData.RollBack();
+    } else {
+      eventData.CommitEvent(eventInfo);
+    }
 
-      eventData.TriggerID = fSettings.at(hit.Module).at(hit.Channel).detectorID;
-      // bool fillFlag = true;
-      const bool fillFlag = true;
-
-      for (auto jHit = iHit + 1; (jHit < nHits) && fillFlag; jHit++) {
-        auto nextHit = fHitData.at(jHit);
-        nextHit.Timestamp -= triggerTime;
-        if (nextHit.Timestamp > fTimeWindow) {
-          break;
-        }
+    // Next trigger candidate
+    if (fOverlapPolicy == OverlapPolicy::DeadTime) {
+      // first hit after triggerTime + fTimeWindow + fTimeWindow
+      iHit = SkipAfter(timestamp, upper, nHits,
+                       triggerTime + fTimeWindow + fTimeWindow);
+    } else {
+      iHit = next;
+    }
+  }
 
-        auto hitType = GetHitType(nextHit.Module);
-        if (hitType == HitType::SiFront) {
-          eventData.SiMultiplicity++;
-          eventData.SiFrontMultiplicity++;
-          frontADC = std::max(frontADC, nextHit.Energy);
-        } else if (hitType == HitType::SiBack) {
-          eventData.SiMultiplicity++;
-          eventData.SiBackMultiplicity++;
-          backADC = std::max(backADC, nextHit.Energy);
-        } else if (hitType == HitType::Gamma) {
-          eventData.GammaMultiplicity++;
-        } else if (hitType == HitType::Neutron) {
-          eventData.NeutronMultiplicity++;
-        }
+  return iHit;
+}
 
-        eventData.HitData.push_back(nextHit);
-      }
+// The slices are built in parallel, each from its first hit.  The window of
+// a trigger near a slice edge reads the hits of the next or previous slice
+// (halo of one time window), so the events of a trigger do not depend on
+// the slicing.  Which hits are triggers does: a slice starts without the
+// dead time (or merged event) of the previous one.  The slices are joined in
+// order: the triggers taken by a slice before the real next candidate are
+// dropped, the events between are built again until both trigger sequences
+// meet, and the events of the slice from there are taken over.
+void TEventBuilder::ParallelBuildEvents()
+{
+  const int32_t nHits = fHitData.Size();
+  const int32_t nSlices =
+      std::min<int32_t>(4 * fNThreads, nHits / kMinSliceHits);
+  std::vector<int32_t> sliceStart(nSlices + 1);
+  for (int32_t i = 0; i <= nSlices; i++) {
+    sliceStart[i] = int64_t(nHits) * i / nSlices;
+  }
 
-      for (auto jHit = iHit - 1; (jHit >= 0) && fillFlag; jHit--) {
-        auto prevHit = fHitData.at(jHit);
+  std::vector<std::unique_ptr<TEventBatch>> sliceEvents(nSlices);
+  std::vector<TBuildOutput> sliceOutput(nSlices);
+  std::vector<int32_t> sliceNext(nSlices);
+  for (int32_t i = 0; i < nSlices; i++) {
+    sliceEvents[i] = NewEventBatch();
+    sliceOutput[i].eventData = sliceEvents[i].get();
+    sliceOutput[i].recordTriggers = true;
+  }
 
-        prevHit.Timestamp -= triggerTime;
-        if (prevHit.Timestamp < -fTimeWindow) {
-          break;
+  TWorkStealingPool pool(fNThreads);
+  pool.Run(nSlices, [&](uint32_t slice, uint32_t) {
+    sliceNext[slice] = BuildEvents(sliceStart[slice], sliceStart[slice + 1],
+                                   true, sliceOutput[slice]);
+  });
+
+  // The first slice starts at the right place
+  std::swap(fEventData, sliceEvents[0]);
+  fNUnknownTypeHits = sliceOutput[0].nUnknownTypeHits;
+  auto next = sliceNext[0];
+
+  TBuildOutput output;
+  output.eventData = fEventData.get();
+  for (int32_t i = 1; i < nSlices; i++) {
+    const auto &slice = sliceOutput[i];
+    const auto stop = sliceStart[i + 1];
+    size_t j = 0;
+    while (true) {
+      for (; j < slice.triggerIndex.size() && slice.triggerIndex[j] < next;
+           j++);
+      if (j == slice.triggerIndex.size()) {
+        // No trigger in common: the rest of the slice is built again
+        if (next < stop) {
+          next = BuildEvents(next, stop, true, output);
         }
+        break;
+      }
+      if (next == slice.triggerIndex[j]) {
+        fEventData->Append(*sliceEvents[i], slice.nEventsBefore[j]);
+        fNUnknownTypeHits +=
+            slice.nUnknownTypeHits - slice.nUnknownTypeHitsBefore[j];
+        next = sliceNext[i];
+        break;
+      }
+      next = BuildEvents(next, slice.triggerIndex[j], true, output);
+    }
+    if (fBatchPool) {
+      fBatchPool->Release(std::move(sliceEvents[i]));
+    }
+  }
+  if (fBatchPool) {
+    fBatchPool->Release(std::move(sliceEvents[0]));
+  }
+  fNUnknownTypeHits += output.nUnknownTypeHits;
+}
 
-        auto hitType = GetHitType(prevHit.Module);
-        if (hitType == HitType::SiFront) {
-          eventData.SiMultiplicity++;
-          eventData.SiFrontMultiplicity++;
-          frontADC = std::max(frontADC, prevHit.Energy);
-        } else if (hitType == HitType::SiBack) {
-          eventData.SiMultiplicity++;
-          eventData.SiBackMultiplicity++;
-          backADC = std::max(backADC, prevHit.Energy);
-        } else if (hitType == HitType::Gamma) {
-          eventData.GammaMultiplicity++;
-        } else if (hitType == HitType::Neutron) {
-          eventData.NeutronMultiplicity++;
-        }
+std::unique_ptr<TEventBatch> TEventBuilder::NewEventBatch()
+{
+  if (fBatchPool) {
+    return fBatchPool->Acquire();
+  }
+  return std::make_unique<TEventBatch>();
+}
 
-        eventData.HitData.push_back(prevHit);
-      }
+uint32_t TEventBuilder::StreamBuild(const EventSink_t &sink)
+{
+  THitReader reader({fFileName}, fSettings, fChunkSize, fReadAheadDepth);
+  reader.SetMemoryBudget(fMemoryBudget);
+  reader.Start();
+  return StreamBuild(reader, sink);
+}
 
-      if (fillFlag) {
-        eventData.IsFissionEvent = (eventData.SiFrontMultiplicity > 0) &&
-                                   (eventData.SiBackMultiplicity > 0) &&
-                                   (frontADC > 1500.0) && (backADC > 1500.0);
-
-        if (fOnlyFissionEvents) {
-          if (eventData.IsFissionEvent) {
-            fEventData->push_back(eventData);
-          }
-        } else {
-          fEventData->push_back(eventData);
+uint32_t TEventBuilder::StreamBuild(THitReader &reader,
+                                    const EventSink_t &sink)
+{
+  auto nEvents = StreamBuild(
+      [&reader](THitBuffer &chunk) { return reader.GetChunk(chunk); }, sink);
+  fNUnknownChannelHits = reader.GetNUnknownChannelHits();
+  PrintUnknownHits();
+  return nEvents;
+}
+
+uint32_t TEventBuilder::StreamBuild(const ChunkSource_t &source,
+                                    const EventSink_t &sink)
+{
+  fHitData.Clear();
+  fNLateHits = 0;
+  fNUnknownChannelHits = 0;
+  fNUnknownTypeHits = 0;
+
+  // Hits below horizon are final: no later hit can be earlier than them.
+  // Trigger candidates below horizon - 2 * window have their whole window
+  // (and the dead time after it) inside the final region.  The start value
+  // leaves room to subtract the windows without overflow.
+  uint32_t nEvents = 0;
+  int32_t nextCandidate = 0;
+  constexpr auto kStartTime = std::numeric_limits<Timestamp_t>::lowest() / 4;
+  Timestamp_t horizon = kStartTime;
+  Timestamp_t maxTS = kStartTime;
+  THitBuffer chunk;
+  for (bool isLast = false; !isLast;) {
+    isLast = !source(chunk);
+    const auto nOld = fHitData.Size();
+    if (!isLast) {
+      for (size_t i = 0; i < chunk.Size(); i++) {
+        if (chunk.Timestamp[i] < horizon) {
+          fNLateHits++;
+          continue;
         }
+        maxTS = std::max(maxTS, chunk.Timestamp[i]);
+        fHitData.PushBack(chunk, i);
       }
+      SortHitData(nOld);
+      ChargeMemory(fHitReservation, MemoryStage::Loader,
+                   fHitData.GetMemorySize() + fSortBuffer.GetMemorySize());
+    }
 
-      // go to the next hit candidate.
-      // it is triggerTime + fTimeWindow + fTimeWindow
-      const auto nextSearchTime = triggerTime + fTimeWindow + fTimeWindow;
-      for (; iHit < nHits; iHit++) {
-        auto nextHit = fHitData.at(iHit);
-        if (nextHit.Timestamp > nextSearchTime) {
-          break;
-        }
+    auto stopTime = std::numeric_limits<Timestamp_t>::max();
+    if (!isLast) {
+      horizon = std::max(horizon, maxTS - fMaxTimeDisorder);
+      stopTime = horizon - fTimeWindow - fTimeWindow;
+    }
+    auto lowerBound = [this](Timestamp_t time) -> int32_t {
+      return std::lower_bound(fHitData.Timestamp.begin(),
+                              fHitData.Timestamp.end(), time) -
+             fHitData.Timestamp.begin();
+    };
+    const auto stop = isLast ? int32_t(fHitData.Size()) : lowerBound(stopTime);
+
+    if (!fEventData) {
+      fEventData = NewEventBatch();
+    }
+    TBuildOutput output;
+    output.eventData = fEventData.get();
+    nextCandidate = BuildEvents(nextCandidate, stop, isLast, output);
+    fNUnknownTypeHits += output.nUnknownTypeHits;
+    nEvents += fEventData->Size();
+    if (fEventData->Size() > 0) {
+      ChargeMemory(fEventReservation, MemoryStage::Builder,
+                   fEventData->GetMemorySize());
+      sink(fEventData);  // normally takes the batch over
+      fEventReservation.Release();
+      if (fEventData) fEventData->Clear();
+    }
+
+    // Keep only what the following trigger candidates can look back to.  A
+    // merged event left for the next chunk (Merge) can start well before
+    // stopTime: its trigger keeps its window.
+    if (!isLast) {
+      auto nErase = std::min(lowerBound(stopTime - fTimeWindow),
+                             nextCandidate);
+      if (nextCandidate < int32_t(fHitData.Size())) {
+        nErase = std::min(
+            nErase,
+            lowerBound(fHitData.Timestamp[nextCandidate] - fTimeWindow));
       }
+      fHitData.EraseFront(nErase);
+      nextCandidate -= nErase;
     }
   }
 
-  return fEventData->size();
-}
\ No newline at end of file
+  if (fNLateHits > 0) {
+    std::cout << "Late hits dropped from " << fFileName << " : " << fNLateHits
+              << " (increase MaxTimeDisorder)" << std::endl;
+  }
+
+  fHitData.Clear();
+  fHitData.ShrinkToFit();
+  fSortBuffer.Clear();
+  fSortBuffer.ShrinkToFit();
+  fSorter.ShrinkToFit();
+  fHitReservation.Release();
+
+  return nEvents;
+}
@@ -1,27 +1,79 @@
 #include "TFileWriter.hpp"
 
+#include <TBranch.h>
+
+#include <algorithm>
 #include <iostream>
+#include <limits>
+
+#include "TChannelTable.hpp"
 
-TFileWriter::TFileWriter(std::string fileName)
+TFileWriter::TFileWriter(std::string fileName, OutputFormat_t format,
+                         const TOutputSettings &settings, size_t maxQueueSize)
+    : fMaxQueueSize(std::max<size_t>(maxQueueSize, 1)), fSettings(settings)
 {
+  if (format == OutputFormat::RNTuple) {
+    InitNTuple(fileName);
+    return;
+  }
   fOutputFile = new TFile(fileName.c_str(), "RECREATE");
+  if (fSettings.compression >= 0) {
+    fOutputFile->SetCompressionSettings(fSettings.compression);
+  }
+  InitTree();
+}
+
+TFileWriter::TFileWriter(std::shared_ptr<ROOT::TBufferMerger> merger,
+                         const TOutputSettings &settings, size_t clusterSize,
+                         size_t maxQueueSize)
+    : fMaxQueueSize(std::max<size_t>(maxQueueSize, 1)),
+      fSettings(settings),
+      fMerger(merger),
+      fClusterSize(clusterSize)
+{
+  fMergerFile = fMerger->GetFile();
+  fOutputFile = fMergerFile.get();
+  InitTree();
+}
+
+void TFileWriter::InitTree()
+{
+  fOutputFile->cd();
   fTree = new TTree("Event_Tree", "Data tree");
   fTree->Branch("IsFissionEvent", &fIsFissionEvent);
   fTree->Branch("TriggerID", &fTriggerID);
-  fTree->Branch("TriggerTime", &fTriggerTime);
+  // Times in integer ps, the hit times relative to TriggerTime
+  fTree->Branch("TriggerTime", &fTriggerTime, "TriggerTime/L");
   fTree->Branch("SiFrontMultiplicity", &fSiFrontMultiplicity);
   fTree->Branch("SiBackMultiplicity", &fSiBackMultiplicity);
   fTree->Branch("SiMultiplicity", &fSiMultiplicity);
   fTree->Branch("GammaMultiplicity", &fGammaMultiplicity);
   fTree->Branch("NeutronMultiplicity", &fNeutronMultiplicity);
-  fTree->Branch("Module", &fModule);
-  fTree->Branch("Channel", &fChannel);
-  fTree->Branch("Timestamp", &fTimestamp);
-  fTree->Branch("Energy", &fEnergy);
-  fTree->Branch("EnergyShort", &fEnergyShort);
+  fTree->Branch("nHits", &fNHits, "nHits/i");
+  // The addresses are set for every event
+  if (fSettings.compactHits) {
+    fChannelIDBranch =
+        fTree->Branch("ChannelID", nullptr, "ChannelID[nHits]/b");
+    fTimestampBranch =
+        fTree->Branch("Timestamp", nullptr, "Timestamp[nHits]/I");
+  } else {
+    fModuleBranch = fTree->Branch("Module", nullptr, "Module[nHits]/b");
+    fChannelBranch = fTree->Branch("Channel", nullptr, "Channel[nHits]/b");
+    fTimestampBranch =
+        fTree->Branch("Timestamp", nullptr, "Timestamp[nHits]/L");
+  }
+  fEnergyBranch = fTree->Branch("Energy", nullptr, "Energy[nHits]/s");
+  fEnergyShortBranch =
+      fTree->Branch("EnergyShort", nullptr, "EnergyShort[nHits]/s");
+  if (fSettings.basketSize > 0) {
+    fTree->SetBasketSize("*", fSettings.basketSize);
+  }
   fTree->SetDirectory(fOutputFile);
-
-  fRawData = std::make_unique<std::vector<TEventData>>();
+  if (fMergerFile) {
+    // One cluster per hand over to the merger
+    fTree->ResetBit(kMustCleanup);
+    fTree->SetAutoFlush(0);
+  }
 
   fWriteDataThread = std::thread(&TFileWriter::WriteData, this);
 }
@@ -31,76 +83,202 @@ TFileWriter::~TFileWriter()
   // delete fOutputFile;
 }
 
-void TFileWriter::SetData(std::unique_ptr<std::vector<TEventData>> &data)
+void TFileWriter::InitNTuple(const std::string &fileName)
 {
-  fMutex.lock();
-  fRawData->insert(fRawData->end(), data->begin(), data->end());
-  fMutex.unlock();
+  auto model = ROOT::Experimental::RNTupleModel::Create();
+  fNIsFissionEvent = model->MakeField<bool>("IsFissionEvent");
+  fNTriggerID = model->MakeField<uint8_t>("TriggerID");
+  fNTriggerTime = model->MakeField<int64_t>("TriggerTime");
+  fNSiFrontMultiplicity = model->MakeField<uint8_t>("SiFrontMultiplicity");
+  fNSiBackMultiplicity = model->MakeField<uint8_t>("SiBackMultiplicity");
+  fNSiMultiplicity = model->MakeField<uint8_t>("SiMultiplicity");
+  fNGammaMultiplicity = model->MakeField<uint8_t>("GammaMultiplicity");
+  fNNeutronMultiplicity = model->MakeField<uint8_t>("NeutronMultiplicity");
+  fNHit = model->MakeField<std::vector<THitRecord>>("Hit");
+  ROOT::Experimental::RNTupleWriteOptions options;
+  if (fSettings.compression >= 0) {
+    options.SetCompression(fSettings.compression);
+  }
+  fNTupleWriter = ROOT::Experimental::RNTupleWriter::Recreate(
+      std::move(model), "Event_NTuple", fileName, options);
+
+  fWriteDataThread = std::thread(&TFileWriter::WriteData, this);
 }
 
-void TFileWriter::Write()
+void TFileWriter::SetData(std::unique_ptr<TEventBatch> &data)
 {
-  while (true) {
-    fMutex.lock();
-    if (fRawData->size() == 0) {
-      fWritingFlag = false;
-      fMutex.unlock();
-      break;
+  const auto bytes = data->GetMemorySize();
+  {
+    std::unique_lock<std::mutex> lock(fMutex);
+    // An empty queue always takes the batch: its memory is allocated anyway
+    fNotFull.wait(lock, [&] {
+      return fRawData.size() < fMaxQueueSize &&
+             (fRawData.empty() || !fMemoryBudget ||
+              fMemoryBudget->HasRoom(bytes));
+    });
+    fRawData.push_back(std::move(data));
+    if (fMemoryBudget) {
+      fRawDataReservations.push_back(
+          fMemoryBudget->Charge(MemoryStage::Writer, bytes));
+    } else {
+      fRawDataReservations.emplace_back();
     }
-    fMutex.unlock();
-    std::this_thread::sleep_for(std::chrono::milliseconds(1));
   }
+  fNotEmpty.notify_one();
+}
+
+void TFileWriter::Write()
+{
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    fClosed = true;
+  }
+  fNotEmpty.notify_one();
   fWriteDataThread.join();
 
-  fMutex.lock();
+  if (fNSaturatedHits > 0) {
+    std::cerr << "Compact hits more than 2.1 ms from their trigger, time "
+                 "saturated: "
+              << fNSaturatedHits << std::endl;
+  }
+
+  if (fNTupleWriter) {
+    fNTupleWriter.reset();  // commits the last cluster and closes the file
+    return;
+  }
+
+  if (fMergerFile) {
+    // The merger writes the output file when the last writer releases it
+    fMergerFile->Write();
+    fMergerFile.reset();
+    fMerger.reset();
+    return;
+  }
+
   fOutputFile->cd();
   fTree->Write();
   fOutputFile->Write();
   fOutputFile->Close();
-  fMutex.unlock();
 }
 
 void TFileWriter::WriteData()
 {
-  fWritingFlag = true;
-
-  while (fWritingFlag) {
-    fMutex.lock();
-    auto size = fRawData->size();
-    fMutex.unlock();
-
-    if (size > 0) {
-      auto localData = std::make_unique<std::vector<TEventData>>();
-      fMutex.lock();
-      localData->insert(localData->end(), fRawData->begin(), fRawData->end());
-      fRawData->clear();
-      fMutex.unlock();
-
-      for (auto &event : *localData) {
-        fIsFissionEvent = event.IsFissionEvent;
-        fTriggerID = event.TriggerID;
-        fTriggerTime = event.TriggerTime;
-        fSiFrontMultiplicity = event.SiFrontMultiplicity;
-        fSiBackMultiplicity = event.SiBackMultiplicity;
-        fSiMultiplicity = event.SiMultiplicity;
-        fGammaMultiplicity = event.GammaMultiplicity;
-        fNeutronMultiplicity = event.NeutronMultiplicity;
-        fModule.clear();
-        fChannel.clear();
-        fTimestamp.clear();
-        fEnergy.clear();
-        fEnergyShort.clear();
-        for (auto &hit : event.HitData) {
-          fModule.push_back(hit.Module);
-          fChannel.push_back(hit.Channel);
-          fTimestamp.push_back(hit.Timestamp);
-          fEnergy.push_back(hit.Energy);
-          fEnergyShort.push_back(hit.EnergyShort);
-        }
-        fTree->Fill();
+  while (true) {
+    std::unique_ptr<TEventBatch> batch;
+    TMemoryReservation reservation;
+    {
+      std::unique_lock<std::mutex> lock(fMutex);
+      fNotEmpty.wait(lock, [this] { return !fRawData.empty() || fClosed; });
+      if (fRawData.empty()) {
+        break;  // closed and everything written
       }
+      batch = std::move(fRawData.front());
+      fRawData.pop_front();
+      reservation = std::move(fRawDataReservations.front());
+      fRawDataReservations.pop_front();
+    }
+    fNotFull.notify_one();
+
+    if (fNTupleWriter) {
+      FillNTuple(*batch);
+    } else {
+      fClusterFilled += FillTree(*batch);
+    }
+    if (fMergerFile && fClusterFilled >= fClusterSize) {
+      fMergerFile->Write();
+      fClusterFilled = 0;
+    }
+
+    if (fBatchPool) {
+      fBatchPool->Release(std::move(batch));
+    }
+    if (reservation.IsValid()) {
+      // Under the lock: SetData() can be between its check and its wait
+      std::lock_guard<std::mutex> lock(fMutex);
+      reservation.Release();
+      fNotFull.notify_all();
+    }
+  }
+}
+
+size_t TFileWriter::FillTree(TEventBatch &batch)
+{
+  constexpr size_t eventSize = sizeof(fIsFissionEvent) + sizeof(fTriggerID) +
+                               sizeof(fTriggerTime) + 5 * sizeof(uint8_t) +
+                               sizeof(fNHits);
+  const size_t hitSize =
+      fSettings.compactHits
+          ? sizeof(uint8_t) + sizeof(int32_t) + 2 * sizeof(uint16_t)
+          : 2 * sizeof(uint8_t) + sizeof(Timestamp_t) + 2 * sizeof(uint16_t);
+  auto &hit = batch.Hit;
+  if (fSettings.compactHits) {
+    EncodeCompactHits(hit);
+  }
+  for (size_t i = 0; i < batch.Size(); i++) {
+    const auto &event = batch.Event[i];
+    fIsFissionEvent = event.IsFissionEvent;
+    fTriggerID = event.TriggerID;
+    fTriggerTime = event.TriggerTime;
+    fSiFrontMultiplicity = event.SiFrontMultiplicity;
+    fSiBackMultiplicity = event.SiBackMultiplicity;
+    fSiMultiplicity = event.SiMultiplicity;
+    fGammaMultiplicity = event.GammaMultiplicity;
+    fNeutronMultiplicity = event.NeutronMultiplicity;
+    fNHits = batch.GetNHits(i);
+    const auto first = batch.HitOffset[i];
+    if (fSettings.compactHits) {
+      fChannelIDBranch->SetAddress(fChannelID.data() + first);
+      fTimestampBranch->SetAddress(fTimestampPs.data() + first);
     } else {
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      fModuleBranch->SetAddress(hit.Module.data() + first);
+      fChannelBranch->SetAddress(hit.Channel.data() + first);
+      fTimestampBranch->SetAddress(hit.Timestamp.data() + first);
+    }
+    fEnergyBranch->SetAddress(hit.Energy.data() + first);
+    fEnergyShortBranch->SetAddress(hit.EnergyShort.data() + first);
+    fTree->Fill();
+  }
+  return batch.Size() * eventSize + hit.Size() * hitSize;
+}
+
+void TFileWriter::EncodeCompactHits(const THitBuffer &hit)
+{
+  // Saturated at the int32 range
+  constexpr Timestamp_t maxPs = std::numeric_limits<int32_t>::max();
+  constexpr Timestamp_t minPs = std::numeric_limits<int32_t>::min();
+  const auto nHits = hit.Size();
+  fChannelID.resize(nHits);
+  fTimestampPs.resize(nHits);
+  for (size_t i = 0; i < nHits; i++) {
+    fChannelID[i] = TChannelTable::GetIndex(hit.Module[i], hit.Channel[i]);
+    fTimestampPs[i] = std::clamp(hit.Timestamp[i], minPs, maxPs);
+    if (fTimestampPs[i] != hit.Timestamp[i]) fNSaturatedHits++;
+  }
+}
+
+void TFileWriter::FillNTuple(const TEventBatch &batch)
+{
+  const auto &hit = batch.Hit;
+  for (size_t i = 0; i < batch.Size(); i++) {
+    const auto &event = batch.Event[i];
+    *fNIsFissionEvent = event.IsFissionEvent;
+    *fNTriggerID = event.TriggerID;
+    *fNTriggerTime = event.TriggerTime;
+    *fNSiFrontMultiplicity = event.SiFrontMultiplicity;
+    *fNSiBackMultiplicity = event.SiBackMultiplicity;
+    *fNSiMultiplicity = event.SiMultiplicity;
+    *fNGammaMultiplicity = event.GammaMultiplicity;
+    *fNNeutronMultiplicity = event.NeutronMultiplicity;
+    fNHit->resize(batch.GetNHits(i));
+    auto record = fNHit->begin();
+    for (auto j = batch.HitOffset[i]; j < batch.HitOffset[i + 1]; j++) {
+      record->Module = hit.Module[j];
+      record->Channel = hit.Channel[j];
+      record->Timestamp = hit.Timestamp[j];
+      record->Energy = hit.Energy[j];
+      record->EnergyShort = hit.EnergyShort[j];
+      ++record;
     }
+    fNTupleWriter->Fill();
   }
-}
\ No newline at end of file
+}
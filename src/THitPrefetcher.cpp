@@ -0,0 +1,93 @@
+#include "THitPrefetcher.hpp"
+
+#include <iostream>
+
+THitPrefetcher::THitPrefetcher(const Factory_t &factory) : fFactory(factory)
+{
+}
+
+THitPrefetcher::~THitPrefetcher()
+{
+  // Not taken loads are finished before their builders are deleted
+  for (auto &pending : fPending) {
+    pending.second.nHits.wait();
+  }
+}
+
+void THitPrefetcher::Prefetch(uint32_t file)
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  if (fPending.count(file) > 0) {
+    return;
+  }
+  auto &pending = fPending[file];
+  pending.builder = fFactory(file);
+  pending.nHits = std::async(std::launch::async, &THitPrefetcher::Load, this,
+                             pending.builder.get(), false);
+}
+
+std::unique_ptr<TEventBuilder> THitPrefetcher::Get(uint32_t file,
+                                                   uint32_t &nHits)
+{
+  std::unique_lock<std::mutex> lock(fMutex);
+  auto it = fPending.find(file);
+  std::unique_ptr<TEventBuilder> builder;
+  const auto start = std::chrono::steady_clock::now();
+  if (it != fPending.end()) {
+    auto pending = std::move(it->second);
+    fPending.erase(it);
+    lock.unlock();
+    nHits = pending.nHits.get();
+    builder = std::move(pending.builder);
+  } else {
+    lock.unlock();
+    builder = fFactory(file);
+    nHits = Load(builder.get(), false);
+  }
+  if (builder->IsLoadDeferred()) {
+    DropPending();
+    nHits = Load(builder.get(), true);
+  }
+  const auto wait =
+      std::chrono::duration<double_t>(std::chrono::steady_clock::now() - start)
+          .count();
+  lock.lock();
+  fWaitTime += wait;
+  return builder;
+}
+
+void THitPrefetcher::DropPending()
+{
+  std::map<uint32_t, TPendingLoad> pending;
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    pending.swap(fPending);
+    fNDropped += pending.size();
+  }
+  for (auto &load : pending) {
+    load.second.nHits.wait();
+  }
+}
+
+uint32_t THitPrefetcher::Load(TEventBuilder *builder, bool waitForMemory)
+{
+  const auto start = std::chrono::steady_clock::now();
+  const auto nHits = builder->LoadHits(waitForMemory);
+  const auto load =
+      std::chrono::duration<double_t>(std::chrono::steady_clock::now() - start)
+          .count();
+  std::lock_guard<std::mutex> lock(fMutex);
+  fLoadTime += load;
+  return nHits;
+}
+
+void THitPrefetcher::PrintStats() const
+{
+  std::cout << "Hit loading: " << fLoadTime << " s, waited for "
+            << fWaitTime << " s, overlap ratio " << GetOverlapRatio()
+            << std::endl;
+  if (fNDropped > 0) {
+    std::cout << "Files loaded in advance and dropped for memory: "
+              << fNDropped << std::endl;
+  }
+}
@@ -0,0 +1,260 @@
+#include "THitReader.hpp"
+
+#include <iostream>
+
+THitReader::THitReader(const std::vector<std::string> &fileList,
+                       const std::vector<std::vector<TChSettings>> &settings,
+                       uint32_t chunkSize, uint32_t readAheadDepth)
+    : fFileList(fileList),
+      fChannelTable(settings),
+      fChunkSize(std::max(chunkSize, 1u)),
+      fReadAheadDepth(std::max(readAheadDepth, 1u))
+{
+}
+
+THitReader::~THitReader()
+{
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    fStop = true;
+    // The read thread can wait for this memory
+    fChunkReservations.clear();
+    fConsumerReservation.Release();
+  }
+  fCondition.notify_all();
+  if (fReadThread.joinable()) {
+    fReadThread.join();
+  }
+}
+
+void THitReader::Start()
+{
+  fReadThread = std::thread(&THitReader::ReadFiles, this);
+}
+
+bool THitReader::GetChunk(THitBuffer &chunk)
+{
+  std::unique_lock<std::mutex> lock(fMutex);
+  if (chunk.Timestamp.capacity() > 0) {
+    chunk.Clear();
+    fFreeChunks.push_back(std::move(chunk));
+  }
+  fConsumerReservation.Release();
+  fCondition.wait(lock, [this] { return !fChunks.empty() || fFinished; });
+  if (fChunks.empty()) {
+    return false;
+  }
+  chunk = std::move(fChunks.front());
+  fChunks.pop_front();
+  fConsumerReservation = std::move(fChunkReservations.front());
+  fChunkReservations.pop_front();
+  fCondition.notify_all();
+  return true;
+}
+
+bool THitReader::PushChunk(THitBuffer &chunk,
+                           TMemoryReservation &reservation)
+{
+  std::unique_lock<std::mutex> lock(fMutex);
+  fCondition.wait(lock, [this] {
+    return fChunks.size() < fReadAheadDepth || fStop;
+  });
+  if (fStop) {
+    return false;
+  }
+  fChunks.push_back(std::move(chunk));
+  fChunkReservations.push_back(std::move(reservation));
+  chunk.Clear();
+  if (fFreeChunks.size() > 0) {
+    chunk = std::move(fFreeChunks.back());
+    fFreeChunks.pop_back();
+  }
+  fCondition.notify_all();
+  return true;
+}
+
+uint32_t THitReader::ReserveChunk(TMemoryReservation &reservation)
+{
+  if (!fMemoryBudget) {
+    return fChunkSize;
+  }
+  for (auto size = fChunkSize; size > kMinChunkSize; size /= 2) {
+    reservation = fMemoryBudget->TryReserve(
+        MemoryStage::Loader, size_t(size) * THitBuffer::kBytesPerHit);
+    if (reservation.IsValid()) {
+      if (size < fChunkSize) fNShrunkChunks++;
+      return size;
+    }
+  }
+  const auto size = std::min(fChunkSize, kMinChunkSize);
+  if (size < fChunkSize) fNShrunkChunks++;
+  // Wait while the consumer has chunks to work on.  Once they are consumed,
+  // the consumer waits for this chunk: it goes over the limit instead.
+  const size_t bytes = size_t(size) * THitBuffer::kBytesPerHit;
+  std::unique_lock<std::mutex> lock(fMutex);
+  fCondition.wait(lock, [&] {
+    if (fStop || fChunks.empty()) return true;
+    reservation = fMemoryBudget->TryReserve(MemoryStage::Loader, bytes);
+    return reservation.IsValid();
+  });
+  if (!reservation.IsValid()) {
+    reservation = fMemoryBudget->Charge(MemoryStage::Loader, bytes);
+  }
+  return size;
+}
+
+void THitReader::ReadFiles()
+{
+  for (const auto &fileName : fFileList) {
+    ReadFile(fileName);
+    std::lock_guard<std::mutex> lock(fMutex);
+    if (fStop) break;
+  }
+
+  std::lock_guard<std::mutex> lock(fMutex);
+  fFinished = true;
+  fCondition.notify_all();
+}
+
+void THitReader::ReadFile(const std::string &fileName)
+{
+  TFile *file = nullptr;
+  HitData_t hit;
+  auto tree = OpenHitTree(fileName, file, hit);
+  if (!tree) {
+    return;
+  }
+
+  // Returns false for a hit of a channel not in the channel settings
+  Timestamp_t timestamp = 0;
+  auto readHit = [&](Long64_t entry) {
+    tree->GetEntry(entry);
+    if (!fChannelTable.Contains(hit.Module, hit.Channel)) {
+      return false;
+    }
+    timestamp = std::llround(hit.Timestamp) +
+                fChannelTable.Get(hit.Module, hit.Channel).timeOffset;
+    return true;
+  };
+
+  const auto nEntries = tree->GetEntries();
+  if (nEntries > 0) {
+    Long64_t first = 0;
+    while (first < nEntries && !readHit(first)) first++;
+    const auto firstTS = timestamp;
+    Long64_t last = nEntries - 1;
+    while (last > first && !readHit(last)) last--;
+    const auto lastTS = timestamp;
+    if (first < nEntries && !CheckTimeRange(fileName, firstTS, lastTS)) {
+      file->Close();
+      delete file;
+      return;
+    }
+  }
+
+  THitBuffer chunk;
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    if (fFreeChunks.size() > 0) {
+      chunk = std::move(fFreeChunks.back());
+      fFreeChunks.pop_back();
+    }
+  }
+  TMemoryReservation reservation;
+  auto chunkSize = ReserveChunk(reservation);
+  chunk.Reserve(std::min<Long64_t>(chunkSize, nEntries));
+  for (Long64_t i = 0; i < nEntries; i++) {
+    if (!readHit(i)) {
+      fNUnknownChannelHits++;
+      continue;
+    }
+    chunk.PushBack(hit, timestamp);
+    if (chunk.Size() == chunkSize) {
+      if (!PushChunk(chunk, reservation)) {
+        break;
+      }
+      chunkSize = ReserveChunk(reservation);
+    }
+  }
+  if (chunk.Size() > 0) {
+    PushChunk(chunk, reservation);
+  }
+  fNHits += nEntries;
+
+  std::cout << "Number of hits from " << fileName << " : " << nEntries
+            << std::endl;
+
+  file->Close();
+  delete file;
+}
+
+TTree *THitReader::OpenHitTree(const std::string &fileName, TFile *&file,
+                               HitData_t &hit)
+{
+  file = TFile::Open(fileName.c_str(), "READ");
+  if (!file) {
+    std::cout << "File not found: " << fileName << std::endl;
+    return nullptr;
+  }
+  auto tree = dynamic_cast<TTree *>(file->Get("ELIADE_Tree"));
+  if (!tree) {
+    std::cout << "Tree not found: " << fileName << std::endl;
+    file->Close();
+    delete file;
+    file = nullptr;
+    return nullptr;
+  }
+  tree->SetBranchStatus("*", kFALSE);
+
+  tree->SetBranchStatus("Ch", kTRUE);
+  tree->SetBranchAddress("Ch", &hit.Channel);
+
+  tree->SetBranchStatus("Mod", kTRUE);
+  tree->SetBranchAddress("Mod", &hit.Module);
+
+  tree->SetBranchStatus("FineTS", kTRUE);
+  tree->SetBranchAddress("FineTS", &hit.Timestamp);
+
+  tree->SetBranchStatus("ChargeLong", kTRUE);
+  tree->SetBranchAddress("ChargeLong", &hit.Energy);
+
+  tree->SetBranchStatus("ChargeShort", kTRUE);
+  tree->SetBranchAddress("ChargeShort", &hit.EnergyShort);
+
+  // Read the baskets of the enabled branches in large blocks, and the next
+  // cluster while the current one is decoded
+  tree->SetCacheSize(kTreeCacheSize);
+  for (auto branch : {"Ch", "Mod", "FineTS", "ChargeLong", "ChargeShort"}) {
+    tree->AddBranchToCache(branch, kTRUE);
+  }
+  tree->StopCacheLearningPhase();
+  tree->SetClusterPrefetch(true);
+
+  return tree;
+}
+
+Long64_t THitReader::GetNEntries(const std::string &fileName)
+{
+  TFile *file = nullptr;
+  HitData_t hit;
+  auto tree = OpenHitTree(fileName, file, hit);
+  if (!tree) {
+    return 0;
+  }
+  const auto nEntries = tree->GetEntries();
+  file->Close();
+  delete file;
+  return nEntries;
+}
+
+bool THitReader::CheckTimeRange(const std::string &fileName,
+                                Timestamp_t firstTS, Timestamp_t lastTS)
+{
+  constexpr Timestamp_t maxRange =
+      ((Timestamp_t(1) << 47) - 1) * kPsPerNs / 4;
+  if (lastTS - firstTS > maxRange) {
+    std::cout << "Rejected: " << fileName << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,174 @@
+#include "THitSorter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <numeric>
+
+static constexpr uint32_t kRadixBits = 8;
+static constexpr uint32_t kNBuckets = 1 << kRadixBits;
+// Locally disordered input: insertion sort while it moves at most this number
+// of hits per hit on average, then the radix sort finishes
+static constexpr size_t kMaxMovesPerHit = 8;
+
+THitSorter::THitSorter(uint32_t nThreads) { SetNThreads(nThreads); }
+
+THitSorter::~THitSorter() {}
+
+void THitSorter::SetNThreads(uint32_t nThreads)
+{
+  fNThreads = std::max(nThreads, 1u);
+  fPool.reset();
+  if (fNThreads > 1) {
+    fPool = std::make_unique<TWorkStealingPool>(fNThreads);
+  }
+}
+
+template <typename F>
+void THitSorter::ForBlocks(size_t n, uint32_t nBlocks, const F &f)
+{
+  if (nBlocks == 1) {
+    f(0, 0, n);
+    return;
+  }
+  fPool->Run(nBlocks, [&](uint32_t block, uint32_t) {
+    f(block, n * block / nBlocks, n * (block + 1) / nBlocks);
+  });
+}
+
+void THitSorter::Sort(const std::vector<Timestamp_t> &timestamp,
+                      uint32_t *first, uint32_t *last)
+{
+  const size_t n = last - first;
+  fLastPath = SortPath::Sorted;
+  fNPasses = 0;
+  if (n < 2) return;
+  const uint32_t nBlocks = (fPool && n >= kMinParallelHits) ? fNThreads : 1;
+
+  // Gather the keys, find their range and whether they are in order
+  fIndex.assign(first, last);
+  fKey.resize(n);
+  std::vector<Timestamp_t> blockMin(nBlocks);
+  std::vector<Timestamp_t> blockMax(nBlocks);
+  std::vector<char> blockSorted(nBlocks);
+  ForBlocks(n, nBlocks, [&](uint32_t block, size_t begin, size_t end) {
+    auto minKey = std::numeric_limits<Timestamp_t>::max();
+    auto maxKey = std::numeric_limits<Timestamp_t>::lowest();
+    bool sorted = true;
+    for (auto i = begin; i < end; i++) {
+      const auto key = timestamp[fIndex[i]];
+      sorted &= (i == 0 || timestamp[fIndex[i - 1]] <= key);
+      minKey = std::min(minKey, key);
+      maxKey = std::max(maxKey, key);
+    }
+    blockMin[block] = minKey;
+    blockMax[block] = maxKey;
+    blockSorted[block] = sorted;
+  });
+  if (std::all_of(blockSorted.begin(), blockSorted.end(),
+                  [](char sorted) { return sorted; })) {
+    return;
+  }
+  const auto minKey = *std::min_element(blockMin.begin(), blockMin.end());
+  const auto maxKey = *std::max_element(blockMax.begin(), blockMax.end());
+  ForBlocks(n, nBlocks, [&](uint32_t, size_t begin, size_t end) {
+    for (auto i = begin; i < end; i++) {
+      fKey[i] = timestamp[fIndex[i]] - minKey;
+    }
+  });
+
+  if (InsertionSort(n)) {
+    fLastPath = SortPath::Insertion;
+  } else {
+    fLastPath = SortPath::Radix;
+    RadixSort(n, nBlocks, maxKey - minKey);
+  }
+  std::copy(fIndex.begin(), fIndex.end(), first);
+}
+
+void THitSorter::Sort(THitBuffer &hits, THitBuffer &buffer)
+{
+  std::vector<uint32_t> index(hits.Size());
+  std::iota(index.begin(), index.end(), 0);
+  Sort(hits.Timestamp, index);
+  if (fLastPath == SortPath::Sorted) return;
+  buffer.Gather(hits, index);
+  hits.Swap(buffer);
+}
+
+// Returns false when the move budget is spent.  The keys are then partly
+// sorted, still a permutation of the input in stable order.
+bool THitSorter::InsertionSort(size_t n)
+{
+  const size_t maxMoves = kMaxMovesPerHit * n;
+  size_t nMoves = 0;
+  for (size_t i = 1; i < n; i++) {
+    if (fKey[i] >= fKey[i - 1]) continue;
+    const auto key = fKey[i];
+    const auto index = fIndex[i];
+    auto j = i;
+    for (; j > 0 && fKey[j - 1] > key; j--) {
+      fKey[j] = fKey[j - 1];
+      fIndex[j] = fIndex[j - 1];
+    }
+    fKey[j] = key;
+    fIndex[j] = index;
+    nMoves += i - j;
+    if (nMoves > maxMoves) return false;
+  }
+  return true;
+}
+
+void THitSorter::RadixSort(size_t n, uint32_t nBlocks, uint64_t range)
+{
+  fKeyBuffer.resize(n);
+  fIndexBuffer.resize(n);
+  typedef std::array<size_t, kNBuckets> Histogram_t;
+  std::vector<Histogram_t> histogram(nBlocks);
+
+  for (uint32_t shift = 0; shift < 64 && (range >> shift) > 0;
+       shift += kRadixBits) {
+    ForBlocks(n, nBlocks, [&](uint32_t block, size_t begin, size_t end) {
+      auto &count = histogram[block];
+      count.fill(0);
+      for (auto i = begin; i < end; i++) {
+        count[(fKey[i] >> shift) & (kNBuckets - 1)]++;
+      }
+    });
+
+    // Output position of each (digit, block), blocks in input order: stable
+    size_t position = 0;
+    bool oneBucket = false;
+    for (uint32_t digit = 0; digit < kNBuckets; digit++) {
+      size_t total = 0;
+      for (auto &count : histogram) {
+        const auto c = count[digit];
+        count[digit] = position + total;
+        total += c;
+      }
+      oneBucket |= (total == n);
+      position += total;
+    }
+    if (oneBucket) continue;  // the same byte for all keys
+
+    ForBlocks(n, nBlocks, [&](uint32_t block, size_t begin, size_t end) {
+      auto &next = histogram[block];
+      for (auto i = begin; i < end; i++) {
+        const auto j = next[(fKey[i] >> shift) & (kNBuckets - 1)]++;
+        fKeyBuffer[j] = fKey[i];
+        fIndexBuffer[j] = fIndex[i];
+      }
+    });
+    fKey.swap(fKeyBuffer);
+    fIndex.swap(fIndexBuffer);
+    fNPasses++;
+  }
+}
+
+void THitSorter::ShrinkToFit()
+{
+  std::vector<uint64_t>().swap(fKey);
+  std::vector<uint64_t>().swap(fKeyBuffer);
+  std::vector<uint32_t>().swap(fIndex);
+  std::vector<uint32_t>().swap(fIndexBuffer);
+}
@@ -0,0 +1,118 @@
+#include "TMemoryBudget.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+TMemoryReservation &TMemoryReservation::operator=(TMemoryReservation &&other)
+{
+  if (this != &other) {
+    Release();
+    fBudget = other.fBudget;
+    fStage = other.fStage;
+    fBytes = other.fBytes;
+    other.fBudget = nullptr;
+    other.fBytes = 0;
+  }
+  return *this;
+}
+
+void TMemoryReservation::Resize(size_t bytes)
+{
+  if (!fBudget) return;
+  std::lock_guard<std::mutex> lock(fBudget->fMutex);
+  if (bytes > fBytes) {
+    fBudget->Add(fStage, bytes - fBytes);
+  } else {
+    fBudget->Remove(fStage, fBytes - bytes);
+  }
+  fBytes = bytes;
+}
+
+void TMemoryReservation::Release()
+{
+  if (!fBudget) return;
+  {
+    std::lock_guard<std::mutex> lock(fBudget->fMutex);
+    fBudget->Remove(fStage, fBytes);
+  }
+  fBudget = nullptr;
+  fBytes = 0;
+}
+
+TMemoryReservation TMemoryBudget::Reserve(MemoryStage_t stage, size_t bytes)
+{
+  std::unique_lock<std::mutex> lock(fMutex);
+  if (!Fits(bytes)) {
+    fNWaiting++;
+    fNWaits++;
+    fReleased.wait(lock, [&] { return Fits(bytes); });
+    fNWaiting--;
+  }
+  Add(stage, bytes);
+  return TMemoryReservation(this, stage, bytes);
+}
+
+TMemoryReservation TMemoryBudget::TryReserve(MemoryStage_t stage,
+                                             size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  if (fNWaiting > 0 || !Fits(bytes)) {
+    return TMemoryReservation();
+  }
+  Add(stage, bytes);
+  return TMemoryReservation(this, stage, bytes);
+}
+
+TMemoryReservation TMemoryBudget::Charge(MemoryStage_t stage, size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  Add(stage, bytes);
+  return TMemoryReservation(this, stage, bytes);
+}
+
+bool TMemoryBudget::HasRoom(size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  return fNWaiting == 0 && Fits(bytes);
+}
+
+size_t TMemoryBudget::GetUsage()
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  return fUsage;
+}
+
+void TMemoryBudget::Add(MemoryStage_t stage, size_t bytes)
+{
+  const auto i = static_cast<uint32_t>(stage);
+  fStageUsage[i] += bytes;
+  fStagePeak[i] = std::max(fStagePeak[i], fStageUsage[i]);
+  fUsage += bytes;
+  fPeak = std::max(fPeak, fUsage);
+}
+
+void TMemoryBudget::Remove(MemoryStage_t stage, size_t bytes)
+{
+  fStageUsage[static_cast<uint32_t>(stage)] -= bytes;
+  fUsage -= bytes;
+  fReleased.notify_all();
+}
+
+void TMemoryBudget::PrintStats() const
+{
+  constexpr double_t MB = 1024. * 1024.;
+  std::cout << "Memory budget: ";
+  if (fLimit > 0) {
+    std::cout << fLimit / MB << " MB";
+  } else {
+    std::cout << "no limit";
+  }
+  std::cout << ", peak " << fPeak / MB << " MB, waited " << fNWaits
+            << " times" << std::endl;
+  const char *stageName[kNStages] = {"loader", "builder", "writer"};
+  for (uint32_t i = 0; i < kNStages; i++) {
+    std::cout << "\tPeak of the " << stageName[i] << " stage: "
+              << fStagePeak[i] / MB << " MB" << std::endl;
+  }
+}
@@ -0,0 +1,125 @@
+#include "TProcessPool.hpp"
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+TProcessPool::TProcessPool(uint32_t nProcesses)
+    : fNProcesses(std::max(nProcesses, 1u))
+{
+}
+
+TProcessPool::~TProcessPool()
+{
+  for (auto fd : fReadFd) {
+    if (fd >= 0) close(fd);
+  }
+  if (fWriteFd >= 0) close(fWriteFd);
+}
+
+uint32_t TProcessPool::Fork()
+{
+  // Nothing buffered is written twice
+  std::cout.flush();
+  std::cerr.flush();
+
+  for (uint32_t i = 0; i < fNProcesses; i++) {
+    int fd[2];
+    if (pipe(fd) != 0) {
+      std::cerr << "Cannot create the pipe of worker " << i << ": "
+                << std::strerror(errno) << std::endl;
+      break;
+    }
+    const auto pid = fork();
+    if (pid < 0) {
+      std::cerr << "Cannot fork worker " << i << ": " << std::strerror(errno)
+                << std::endl;
+      close(fd[0]);
+      close(fd[1]);
+      break;
+    }
+    if (pid == 0) {
+      close(fd[0]);
+      for (auto readFd : fReadFd) close(readFd);
+      fReadFd.clear();
+      fPid.clear();
+      fWriteFd = fd[1];
+      fWorker = i;
+      return fWorker;
+    }
+    close(fd[1]);
+    fPid.push_back(pid);
+    fReadFd.push_back(fd[0]);
+  }
+  return kCoordinator;
+}
+
+void TProcessPool::Report(const std::string &message)
+{
+  if (fWriteFd < 0) return;
+  const auto line = message + "\n";
+  // Lines up to PIPE_BUF bytes are written at once
+  size_t written = 0;
+  while (written < line.size()) {
+    const auto n = write(fWriteFd, line.data() + written,
+                         line.size() - written);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    written += n;
+  }
+}
+
+uint32_t TProcessPool::Wait(const MessageHandler_t &onMessage)
+{
+  std::vector<std::string> buffer(fReadFd.size());
+  std::vector<pollfd> fds;
+  for (auto fd : fReadFd) fds.push_back({fd, POLLIN, 0});
+
+  uint32_t nOpen = fds.size();
+  while (nOpen > 0) {
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      std::cerr << "poll: " << std::strerror(errno) << std::endl;
+      break;
+    }
+    for (uint32_t i = 0; i < fds.size(); i++) {
+      if (fds[i].fd < 0 || fds[i].revents == 0) continue;
+      char data[4096];
+      const auto n = read(fds[i].fd, data, sizeof(data));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        // The worker has exited (or closed its pipe)
+        close(fds[i].fd);
+        fReadFd[i] = -1;
+        fds[i].fd = -1;
+        nOpen--;
+        continue;
+      }
+      buffer[i].append(data, n);
+      size_t end;
+      while ((end = buffer[i].find('\n')) != std::string::npos) {
+        onMessage(i, buffer[i].substr(0, end));
+        buffer[i].erase(0, end + 1);
+      }
+    }
+  }
+
+  uint32_t nFailed = fNProcesses - fPid.size();  // not forked
+  for (uint32_t i = 0; i < fPid.size(); i++) {
+    int status = 0;
+    while (waitpid(fPid[i], &status, 0) < 0 && errno == EINTR);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      std::cerr << "Worker process " << i << " failed." << std::endl;
+      nFailed++;
+    }
+  }
+  fPid.clear();
+  return nFailed;
+}
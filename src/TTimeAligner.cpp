@@ -0,0 +1,190 @@
+#include "TTimeAligner.hpp"
+
+#include <TF1.h>
+#include <TFile.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+TTimeAligner::TTimeAligner(
+    const std::vector<std::vector<TChSettings>> &settings, uint32_t refModule,
+    uint32_t refChannel, double_t timeWindow, uint32_t nWorkers)
+    : fChannelTable(settings),
+      fRefIndex(TChannelTable::GetIndex(refModule, refChannel)),
+      fTimeWindow(NsToPs(timeWindow)),
+      fWorker(std::max(nWorkers, 1u))
+{
+  if (!fChannelTable.Contains(refModule, refChannel)) {
+    std::cerr << "Reference channel of the time alignment, module "
+              << refModule << " channel " << refChannel
+              << ", is not in the channel settings." << std::endl;
+  }
+
+  // 0.1 ns bins, the first centered on -window
+  fNBins = (2 * fTimeWindow + kBinWidth / 2) / kBinWidth + 1;
+  for (auto &worker : fWorker) {
+    worker.counts.Resize(size_t(fChannelTable.Size()) * fNBins);
+  }
+}
+
+void TTimeAligner::Fill(const THitBuffer &hits, uint32_t worker)
+{
+  auto &counts = fWorker[worker].counts;
+  const auto nHits = hits.Size();
+  const auto timestamp = hits.Timestamp.data();
+
+  // The window of the trigger before is the start of the next one
+  size_t first = 0;
+  for (size_t i = 0; i < nHits; i++) {
+    if (TChannelTable::GetIndex(hits.Module[i], hits.Channel[i]) != fRefIndex)
+      continue;
+
+    const auto triggerTime = timestamp[i];
+    const auto isGated = hits.Energy[i] >= fTriggerADCMin &&
+                         hits.Energy[i] <= fTriggerADCMax;
+    while (timestamp[first] < triggerTime - fTimeWindow) first++;
+    for (auto j = first; j < nHits; j++) {
+      const auto dt = timestamp[j] - triggerTime;
+      if (dt > fTimeWindow) break;
+      if (j == i) continue;
+
+      const auto index = TChannelTable::GetIndex(hits.Module[j],
+                                                 hits.Channel[j]);
+      const auto hitType = fChannelTable[index].hitType;
+      const auto isSi =
+          hitType == HitType::SiFront || hitType == HitType::SiBack;
+      if (!isGated && !isSi) continue;
+
+      const auto bin = (dt + fTimeWindow + kBinWidth / 2) / kBinWidth;
+      counts.Add(size_t(index) * fNBins + bin);
+    }
+  }
+}
+
+bool TTimeAligner::FitPeak(TH1D *hist, double_t sigma)
+{
+  if (hist->GetEntries() == 0) {
+    return false;
+  }
+  auto mean = hist->GetBinCenter(hist->GetMaximumBin());
+  TF1 f("f", "gaus", mean - 1 * sigma, mean + 1 * sigma);
+  f.SetParameters(hist->GetMaximum(), mean, sigma);
+  hist->Fit(&f, "QR", "", mean - 1 * sigma, mean + 1 * sigma);
+
+  f.SetRange(mean - 1 * sigma, mean + 1 * sigma);
+  hist->Fit(&f, "QR", "", mean - 1 * sigma, mean + 1 * sigma);
+
+  hist->GetXaxis()->SetRangeUser(mean - 5 * sigma, mean + 5 * sigma);
+  return hist->GetFunction("f") != nullptr;
+}
+
+uint32_t TTimeAligner::Align(std::vector<std::vector<TChSettings>> &settings)
+{
+  auto &counts = fWorker[0].counts;
+  for (size_t i = 1; i < fWorker.size(); i++) {
+    counts.Add(fWorker[i].counts);
+    fWorker[i].counts.Clear();
+  }
+
+  const auto refModule = fRefIndex / TChannelTable::kNChannels;
+  const auto refChannel = fRefIndex % TChannelTable::kNChannels;
+  if (!fChannelTable.Contains(refModule, refChannel)) {
+    return 0;
+  }
+  const auto &refSettings = settings.at(refModule).at(refChannel);
+  // Moving the reference to its time of flight moves all channels
+  const auto refShift =
+      refSettings.distance / kLightSpeed - refSettings.timeOffset;
+  const auto refTof = refSettings.distance / kLightSpeed;
+
+  const auto xMin = -double_t(fTimeWindow + kBinWidth / 2) / kPsPerNs;
+  const auto xMax = xMin + double_t(fNBins * kBinWidth) / kPsPerNs;
+  fHists.clear();
+  uint32_t nAligned = 0;
+  for (uint32_t mod = 0; mod < settings.size(); mod++) {
+    for (uint32_t ch = 0;
+         ch < settings[mod].size() && ch < TChannelTable::kNChannels; ch++) {
+      auto &chSettings = settings[mod][ch];
+      const auto index = TChannelTable::GetIndex(mod, ch);
+
+      auto hist = std::make_unique<TH1D>(
+          Form("histTof_%d_%d", mod, ch),
+          Form("Time of flight for Module %d, Channel %d", mod, ch), fNBins,
+          xMin, xMax);
+      hist->SetDirectory(nullptr);
+      hist->GetXaxis()->SetTitle("Time of flight (ns)");
+      uint64_t nEntries = 0;
+      for (uint32_t bin = 0; bin < fNBins; bin++) {
+        const auto count = counts.Get(size_t(index) * fNBins + bin);
+        hist->SetBinContent(bin + 1, count);
+        nEntries += count;
+      }
+      hist->SetEntries(nEntries);
+
+      const auto hitType = fChannelTable[index].hitType;
+      const auto isSi =
+          hitType == HitType::SiFront || hitType == HitType::SiBack;
+      // Si: wide peak
+      const auto isFitted = FitPeak(hist.get(), isSi ? 20 : 2);
+      if (index == fRefIndex) {
+        chSettings.timeOffset = refTof;
+        nAligned++;
+      } else if (isFitted) {
+        auto mean = hist->GetFunction("f")->GetParameter(1);
+        if (isSi) mean = hist->GetMean();
+        const auto tof = chSettings.distance / kLightSpeed;
+        chSettings.timeOffset += refShift + (tof - refTof) - mean;
+        nAligned++;
+      } else {
+        chSettings.timeOffset += refShift;
+        std::cout << "Module " << mod << ", Channel " << ch
+                  << ": no peak, time offset kept relative to the reference"
+                  << std::endl;
+      }
+      std::cout << "Module " << mod << ", Channel " << ch
+                << ", time offset: " << chSettings.timeOffset << std::endl;
+      fHists.push_back(std::move(hist));
+    }
+  }
+  counts.Clear();
+
+  return nAligned;
+}
+
+void TTimeAligner::Write(const std::string &fileName) const
+{
+  TFile file(fileName.c_str(), "RECREATE");
+  if (file.IsZombie()) {
+    std::cerr << "Cannot open " << fileName << std::endl;
+    return;
+  }
+  for (const auto &hist : fHists) hist->Write();
+  file.Close();
+}
+
+bool TTimeAligner::WriteTimeOffsets(
+    const std::string &fileName,
+    const std::vector<std::vector<TChSettings>> &settings)
+{
+  std::ifstream ifs(fileName);
+  if (!ifs) {
+    std::cerr << "Cannot open " << fileName << std::endl;
+    return false;
+  }
+  nlohmann::json jsonFile;
+  ifs >> jsonFile;
+  ifs.close();
+  for (uint32_t mod = 0; mod < settings.size() && mod < jsonFile.size();
+       mod++) {
+    for (uint32_t ch = 0;
+         ch < settings[mod].size() && ch < jsonFile.at(mod).size(); ch++) {
+      jsonFile.at(mod).at(ch)["TimeOffset"] = settings[mod][ch].timeOffset;
+    }
+  }
+  std::ofstream ofs(fileName);
+  ofs << jsonFile.dump(4);
+  ofs.close();
+  return true;
+}
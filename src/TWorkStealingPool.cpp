@@ -0,0 +1,106 @@
+#include "TWorkStealingPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+TWorkStealingPool::TWorkStealingPool(uint32_t nThreads)
+    : fNThreads(std::max(nThreads, 1u))
+{
+  for (uint32_t i = 0; i < fNThreads; i++) {
+    fQueues.push_back(std::make_unique<TTaskQueue>());
+  }
+}
+
+TWorkStealingPool::~TWorkStealingPool() {}
+
+void TWorkStealingPool::Run(uint32_t nTasks, const Task_t &task)
+{
+  fBusyTime.assign(fNThreads, 0.);
+  fNTasks.assign(fNThreads, 0);
+  const auto start = std::chrono::steady_clock::now();
+
+  for (auto &queue : fQueues) {
+    queue->nReserved = 0;
+  }
+  for (uint32_t i = 0; i < nTasks; i++) {
+    fQueues[i % fNThreads]->tasks.push_back(i);
+  }
+
+  // The calling thread is the worker 0
+  std::vector<std::thread> threads;
+  const auto nWorkers = std::min(fNThreads, std::max(nTasks, 1u));
+  for (uint32_t i = 1; i < nWorkers; i++) {
+    threads.push_back(std::thread(&TWorkStealingPool::Work, this, i,
+                                  std::cref(task)));
+  }
+  Work(0, task);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  fRunTime = std::chrono::duration<double_t>(std::chrono::steady_clock::now() -
+                                             start)
+                 .count();
+}
+
+void TWorkStealingPool::Work(uint32_t worker, const Task_t &task)
+{
+  uint32_t iTask = 0;
+  while (PopTask(worker, iTask)) {
+    const auto start = std::chrono::steady_clock::now();
+    task(iTask, worker);
+    fBusyTime[worker] += std::chrono::duration<double_t>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    fNTasks[worker]++;
+  }
+}
+
+bool TWorkStealingPool::PopTask(uint32_t worker, uint32_t &task)
+{
+  {
+    auto &queue = *fQueues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.size() > 0) {
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+      if (queue.nReserved > 0) queue.nReserved--;
+      return true;
+    }
+  }
+
+  // No task is added during Run(): all queues empty means done
+  for (uint32_t i = 1; i < fNThreads; i++) {
+    auto &victim = *fQueues[(worker + i) % fNThreads];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (victim.tasks.size() > victim.nReserved) {
+      task = victim.tasks.back();
+      victim.tasks.pop_back();
+      fNSteals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<uint32_t> TWorkStealingPool::PeekTasks(uint32_t worker,
+                                                  uint32_t depth)
+{
+  auto &queue = *fQueues[worker];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  queue.nReserved = std::min<size_t>(depth, queue.tasks.size());
+  return std::vector<uint32_t>(queue.tasks.begin(),
+                               queue.tasks.begin() + queue.nReserved);
+}
+
+void TWorkStealingPool::PrintStats() const
+{
+  for (uint32_t i = 0; i < fNThreads; i++) {
+    std::cout << "Worker " << i << ": " << fNTasks[i] << " tasks, busy "
+              << fBusyTime[i] << " s, idle " << GetIdleTime(i) << " s"
+              << std::endl;
+  }
+  std::cout << "Stolen tasks: " << fNSteals << std::endl;
+}
@@ -0,0 +1,160 @@
+#include "TAnalysisRunner.hpp"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#include "TWorkStealingPool.hpp"
+
+TAnalysisRunner::TAnalysisRunner(uint32_t nThreads)
+    : fNThreads(std::max(nThreads, 1u))
+{
+}
+
+void TAnalysisRunner::AddDirectory(const std::string &directory,
+                                   const std::string &key)
+{
+  if (!std::filesystem::exists(directory)) {
+    std::cerr << "Directory not found: " << directory << std::endl;
+    return;
+  }
+  std::vector<std::string> fileList;
+  for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+    if (entry.path().filename().string().find(key) != std::string::npos) {
+      fileList.push_back(entry.path().string());
+    }
+  }
+  std::sort(fileList.begin(), fileList.end());
+  fFileList.insert(fFileList.end(), fileList.begin(), fileList.end());
+}
+
+std::vector<TAnalysisRunner::TEntryRange> TAnalysisRunner::GetEntryRanges(
+    const std::vector<std::string> &fields, uint64_t &nEntries) const
+{
+  std::vector<std::unique_ptr<TEventReader>> readers;
+  nEntries = 0;
+  for (const auto &fileName : fFileList) {
+    readers.push_back(std::make_unique<TEventReader>(fileName, fields));
+    nEntries += readers.back()->GetEntries();
+  }
+
+  const Long64_t minEntries = nEntries / (fNThreads * kRangesPerThread);
+  std::vector<TEntryRange> ranges;
+  for (uint32_t i = 0; i < readers.size(); i++) {
+    if (!readers[i]->IsOpen()) continue;
+    for (const auto &[first, last] : readers[i]->GetEntryRanges(minEntries)) {
+      ranges.push_back({i, first, last});
+    }
+  }
+  std::stable_sort(ranges.begin(), ranges.end(),
+                   [](const TEntryRange &a, const TEntryRange &b) {
+                     return a.last - a.first > b.last - b.first;
+                   });
+  return ranges;
+}
+
+uint64_t TAnalysisRunner::Run(TAnalysisModule &module)
+{
+  ROOT::EnableThreadSafety();
+
+  const auto fields = module.GetFields();
+  uint64_t nEntries = 0;
+  const auto ranges = GetEntryRanges(fields, nEntries);
+  std::cout << "Files: " << fFileList.size() << ", events: " << nEntries
+            << ", entry ranges: " << ranges.size()
+            << ", threads: " << fNThreads << std::endl;
+
+  module.Init(fNThreads);
+
+  // One open file per worker, kept while its ranges are of the same file
+  std::vector<std::unique_ptr<TEventReader>> readers(fNThreads);
+  std::vector<uint32_t> readerFile(fNThreads, ~0u);
+  std::atomic<uint64_t> nProcessed = 0;
+  std::atomic<bool> isDone = false;
+
+  const auto startTime = std::chrono::high_resolution_clock::now();
+  std::thread progress([&]() {
+    auto lastTime = startTime;
+    while (!isDone) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      const auto now = std::chrono::high_resolution_clock::now();
+      if (now - lastTime < std::chrono::seconds(1)) continue;
+      const uint64_t finishedEvents = nProcessed;
+      if (finishedEvents == 0) continue;
+      const auto elapsed =
+          std::chrono::duration<double_t>(now - startTime).count();
+      const auto remainingTime =
+          (nEntries - finishedEvents) * elapsed / finishedEvents;
+      std::cout << "\b\r" << "Processing event " << finishedEvents << " / "
+                << nEntries << ", " << int(remainingTime) << "s  \b\b"
+                << std::flush;
+      lastTime = now;
+    }
+  });
+
+  TWorkStealingPool pool(fNThreads);
+  pool.Run(ranges.size(), [&](uint32_t task, uint32_t worker) {
+    const auto &range = ranges[task];
+    auto &reader = readers[worker];
+    if (readerFile[worker] != range.file) {
+      reader.reset();
+      reader = std::make_unique<TEventReader>(fFileList[range.file], fields);
+      readerFile[worker] = range.file;
+    }
+    if (!reader->IsOpen()) return;
+    constexpr Long64_t nProgress = 1000;
+    for (auto entry = range.first; entry < range.last; entry++) {
+      reader->GetEntry(entry);
+      module.Process(*reader, worker);
+      if ((entry - range.first + 1) % nProgress == 0) nProcessed += nProgress;
+    }
+    nProcessed += (range.last - range.first) % nProgress;
+  });
+  readers.clear();
+  isDone = true;
+  progress.join();
+
+  const auto elapsed = std::chrono::duration<double_t>(
+                           std::chrono::high_resolution_clock::now() -
+                           startTime)
+                           .count();
+  std::cout << "\b\r" << "Processing event " << nProcessed << " / "
+            << nEntries << ", spent " << int(elapsed) << "s  \b\b"
+            << std::endl;
+  pool.PrintStats();
+
+  module.Finish();
+  return nProcessed;
+}
+
+std::unique_ptr<TAnalysisModule> TAnalysisRunner::LoadModule(
+    const std::string &path)
+{
+  auto fileName = path;
+  if (fileName.find('/') == std::string::npos) {
+    if (std::filesystem::path(fileName).extension() != ".so") {
+      fileName += ".so";
+    }
+    std::error_code error;
+    auto executable = std::filesystem::read_symlink("/proc/self/exe", error);
+    if (!error) fileName = (executable.parent_path() / fileName).string();
+  }
+  // Never closed: the code of the module is needed while it lives
+  auto handle = dlopen(fileName.c_str(), RTLD_NOW);
+  if (!handle) {
+    std::cerr << "Cannot load " << fileName << ": " << dlerror() << std::endl;
+    return nullptr;
+  }
+  auto factory = reinterpret_cast<AnalysisModuleFactory_t>(
+      dlsym(handle, "CreateAnalysisModule"));
+  if (!factory) {
+    std::cerr << "No analysis module in " << fileName << std::endl;
+    return nullptr;
+  }
+  return std::unique_ptr<TAnalysisModule>(factory());
+}
@@ -0,0 +1,64 @@
+// A unit claimed long after the campaign was created must not have an
+// expired lease: its todo file is backdated by an hour, a worker claims it
+// and builds it (a script of 2 s) while the coordinator expires the leases.
+// The unit must be done at its first attempt.
+// Usage: test_campaign
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+
+#include "TCampaign.hpp"
+
+namespace fs = std::filesystem;
+
+int main()
+{
+  const auto directory = fs::temp_directory_path() /
+                         ("test_campaign_" + std::to_string(getpid()));
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+
+  const auto executable = directory / "build.sh";
+  {
+    std::ofstream script(executable);
+    script << "#!/bin/sh\nsleep 2\n";
+  }
+  chmod(executable.c_str(), 0755);
+
+  const TWorkUnit unit(1, 0, 0);
+  const auto name = unit.GetName() + ".json";
+  TCampaign coordinator((directory / "lease").string());
+  if (!coordinator.Create({{"MaxRetries", 2}}, {unit})) return 1;
+  fs::last_write_time(directory / "lease" / "todo" / name,
+                      fs::file_time_type::clock::now() - std::chrono::hours(1));
+
+  uint32_t nWorkerFailed = 0;
+  std::thread worker([&] {
+    TCampaign campaign((directory / "lease").string());
+    nWorkerFailed = campaign.Work(executable.string());
+  });
+  // The coordinator starts once the unit is running
+  while (fs::exists(directory / "lease" / "todo" / name)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  const auto nFailed = coordinator.Coordinate(60.);
+  worker.join();
+
+  nlohmann::json report;
+  std::ifstream file(directory / "lease" / "done" / name);
+  if (file.is_open()) report = nlohmann::json::parse(file, nullptr, false);
+  const auto isDone = report.is_object() && report.value("Attempts", -1) == 0;
+  std::cout << "Backdated unit: "
+            << (isDone ? "done at the first attempt" : "EXPIRED") << std::endl;
+
+  fs::remove_all(directory);
+  return (isDone && nFailed == 0 && nWorkerFailed == 0) ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+// Events written by TFileWriter must be read back by TEventReader as they
+// were built, for the TTree, compact TTree and RNTuple formats.
+// Usage: test_event_io
+
+#include <TFileMerger.h>
+
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "TEventBatch.hpp"
+#include "TEventReader.hpp"
+#include "TFileWriter.hpp"
+#include "TOutputSettings.hpp"
+
+namespace
+{
+// Events of nHits[i] hits, times relative to the trigger in ps
+std::unique_ptr<TEventBatch> GenerateEvents(
+    const std::vector<uint32_t> &nHits = {3, 0, 1, 300, 7})
+{
+  auto batch = std::make_unique<TEventBatch>();
+  for (uint32_t i = 0; i < nHits.size(); i++) {
+    for (uint32_t j = 0; j < nHits[i]; j++) {
+      HitData_t hit((i + j) % 10, j % 16, 0., 100 * i + j, 50 * i + j);
+      batch->Hit.PushBack(hit, int64_t(j) * 12345 - 1000000 * i);
+    }
+    TEventInfo info;
+    info.IsFissionEvent = (i % 2 == 0);
+    info.TriggerID = i + 1;
+    info.SiFrontMultiplicity = i;
+    info.SiBackMultiplicity = i + 1;
+    info.SiMultiplicity = 2 * i + 1;
+    info.GammaMultiplicity = i + 2;
+    info.NeutronMultiplicity = i + 3;
+    info.TriggerTime = 1000000000000 + 1234567 * int64_t(i);
+    batch->CommitEvent(info);
+  }
+  return batch;
+}
+
+void WriteEvents(const std::string &fileName, OutputFormat_t format,
+                 const TOutputSettings &settings, const TEventBatch &events)
+{
+  TFileWriter writer(fileName, format, settings);
+  auto batch = std::make_unique<TEventBatch>(events);
+  writer.SetData(batch);
+  writer.Write();
+}
+
+bool Check(const std::string &fileName, const TEventBatch &batch)
+{
+  TEventReader reader(fileName);
+  if (!reader.IsOpen() || reader.GetEntries() != Long64_t(batch.Size())) {
+    return false;
+  }
+  for (size_t i = 0; i < batch.Size(); i++) {
+    reader.GetEntry(i);
+    const auto &info = batch.Event[i];
+    if (reader.IsFissionEvent != info.IsFissionEvent ||
+        reader.TriggerID != info.TriggerID ||
+        reader.TriggerTime != info.TriggerTime * 1.e-3 ||
+        reader.SiFrontMultiplicity != info.SiFrontMultiplicity ||
+        reader.SiBackMultiplicity != info.SiBackMultiplicity ||
+        reader.SiMultiplicity != info.SiMultiplicity ||
+        reader.GammaMultiplicity != info.GammaMultiplicity ||
+        reader.NeutronMultiplicity != info.NeutronMultiplicity ||
+        reader.Module.size() != batch.GetNHits(i)) {
+      return false;
+    }
+    for (uint32_t j = 0; j < batch.GetNHits(i); j++) {
+      const auto k = batch.HitOffset[i] + j;
+      if (reader.Module.at(j) != batch.Hit.Module[k] ||
+          reader.Channel.at(j) != batch.Hit.Channel[k] ||
+          reader.Timestamp.at(j) != batch.Hit.Timestamp[k] * 1.e-3 ||
+          reader.Energy.at(j) != batch.Hit.Energy[k] ||
+          reader.EnergyShort.at(j) != batch.Hit.EnergyShort[k]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+}  // namespace
+
+int main()
+{
+  const auto expected = GenerateEvents();
+
+  TOutputSettings compact;
+  compact.compactHits = true;
+  const std::vector<std::tuple<std::string, OutputFormat_t, TOutputSettings>>
+      formats = {{"TTree", OutputFormat::TTree, TOutputSettings()},
+                 {"CompactTTree", OutputFormat::TTree, compact},
+                 {"RNTuple", OutputFormat::RNTuple, TOutputSettings()}};
+  auto nFailed = 0;
+  for (const auto &[name, format, settings] : formats) {
+    const auto fileName = "test_event_io_" + name + ".root";
+    WriteEvents(fileName, format, settings, *expected);
+    const auto isSame = Check(fileName, *expected);
+    std::cout << name << ": " << (isSame ? "OK" : "MISMATCH") << std::endl;
+    if (!isSame) nFailed++;
+    std::remove(fileName.c_str());
+  }
+
+  // Merged file whose first part has small events only: the reader must not
+  // size the hit arrays from the maximum of nHits stored in the file
+  {
+    const auto small = GenerateEvents({3, 0, 1});
+    const auto large = GenerateEvents({300, 7});
+    WriteEvents("test_event_io_small.root", OutputFormat::TTree,
+                TOutputSettings(), *small);
+    WriteEvents("test_event_io_large.root", OutputFormat::TTree,
+                TOutputSettings(), *large);
+    TFileMerger merger(kFALSE);
+    merger.OutputFile("test_event_io_merged.root", "RECREATE");
+    merger.AddFile("test_event_io_small.root", kFALSE);
+    merger.AddFile("test_event_io_large.root", kFALSE);
+    TEventBatch merged(*small);
+    merged.Append(*large);
+    const auto isSame =
+        merger.Merge() && Check("test_event_io_merged.root", merged);
+    std::cout << "Merged TTree: " << (isSame ? "OK" : "MISMATCH")
+              << std::endl;
+    if (!isSame) nFailed++;
+    for (auto name : {"small", "large", "merged"}) {
+      std::remove(("test_event_io_" + std::string(name) + ".root").c_str());
+    }
+  }
+
+  return (nFailed > 0) ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+// TLocalHist and TCompactHist2D must give the same histogram, statistics
+// included, bit for bit for any number of workers and any sharing of the
+// values between them.
+// Usage: test_local_hist
+
+#include <TH1.h>
+#include <TH2.h>
+
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "TCompactHist2D.hpp"
+#include "TLocalHist.hpp"
+
+namespace
+{
+struct TResult {
+  std::vector<double_t> contents;
+  double_t stats[TH1::kNstat] = {};
+  double_t entries = 0.;
+};
+
+TResult GetResult(TH1 *hist)
+{
+  TResult result;
+  for (int32_t bin = 0; bin < hist->GetNcells(); bin++) {
+    result.contents.push_back(hist->GetBinContent(bin));
+  }
+  hist->GetStats(result.stats);
+  result.entries = hist->GetEntries();
+  return result;
+}
+
+bool IsSame(const TResult &a, const TResult &b)
+{
+  return a.contents == b.contents && a.entries == b.entries &&
+         std::memcmp(a.stats, b.stats, sizeof(a.stats)) == 0;
+}
+}  // namespace
+
+int main()
+{
+  // Some values out of the axis range, some integers (ADC-like)
+  std::mt19937_64 rng(1);
+  std::normal_distribution<double_t> value(50., 30.);
+  std::vector<std::pair<double_t, double_t>> values(200000);
+  for (size_t i = 0; i < values.size(); i++) {
+    const auto x = (i % 3 == 0) ? double_t(int32_t(value(rng))) : value(rng);
+    values[i] = {x, value(rng) * 0.37};
+  }
+
+  auto nFailed = 0;
+  TResult expected1D, expected2D, expectedCompact;
+  for (uint32_t nWorkers : {1, 2, 3, 16}) {
+    TH1D hist1D("hist1D", "", 100, 0., 100.);
+    TH2D hist2D("hist2D", "", 50, 0., 100., 50, 0., 40.);
+    hist1D.SetDirectory(nullptr);
+    hist2D.SetDirectory(nullptr);
+    TLocalHist<TH1D> local1D(&hist1D, nWorkers);
+    TLocalHist<TH2D> local2D(&hist2D, nWorkers);
+    TCompactHist2D compact("compact", "", 50, 0., 100., 50, 0., 40.,
+                           nWorkers);
+    for (size_t i = 0; i < values.size(); i++) {
+      const auto [x, y] = values[i];
+      // Another sharing for each histogram, merged once on the way
+      local1D.Fill(i % nWorkers, x);
+      local2D.Fill((i / 7) % nWorkers, x, y);
+      compact.Fill((i * 2654435761u) % nWorkers, x, y);
+      if (i == values.size() / 3) local2D.Merge();
+    }
+    local1D.Merge();
+    local2D.Merge();
+    compact.Merge();
+
+    const auto result1D = GetResult(&hist1D);
+    const auto result2D = GetResult(&hist2D);
+    const auto resultCompact = GetResult(compact.Get());
+    if (nWorkers == 1) {
+      expected1D = result1D;
+      expected2D = result2D;
+      expectedCompact = resultCompact;
+    }
+    const auto isSame = IsSame(expected1D, result1D) &&
+                        IsSame(expected2D, result2D) &&
+                        IsSame(expectedCompact, resultCompact);
+    std::cout << nWorkers << " workers: mean " << hist1D.GetMean() << ", RMS "
+              << hist1D.GetRMS() << (isSame ? " OK" : " MISMATCH")
+              << std::endl;
+    if (!isSame) nFailed++;
+  }
+
+  return (nFailed > 0) ? 1 : 0;
+}
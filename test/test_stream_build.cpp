@@ -0,0 +1,186 @@
+// StreamBuild() must give the same events as EventBuild() on the same hits,
+// for every overlap policy.  The hits are synthetic, fed to StreamBuild() in
+// small chunks so that the merged events of OverlapPolicy::Merge cross many
+// chunk ends.  EventBuild() with 4 threads (time slices joined in
+// ParallelBuildEvents()) must also give the events of one thread.
+// Usage: test_stream_build
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TChSettings.hpp"
+#include "TEventBatch.hpp"
+#include "TEventBuilder.hpp"
+#include "THitBuffer.hpp"
+
+namespace
+{
+constexpr double_t kTimeWindow = 1000.;  // ns
+constexpr uint32_t kNModules = 4;
+// 11 slices of kMinSliceHits (TEventBuilder.cpp) with 4 threads, and more
+// than kMinParallelHits: the hits are also sorted in parallel
+constexpr size_t kNParallelHits = 11 * 100000;
+constexpr uint32_t kNSlices = 11;
+
+// SiFront, SiBack, Gamma (channel 0 of module 2 is the trigger), Neutron
+std::vector<std::vector<TChSettings>> GetSettings()
+{
+  std::vector<std::vector<TChSettings>> settings(kNModules);
+  for (uint32_t mod = 0; mod < kNModules; mod++) {
+    for (uint32_t ch = 0; ch < TChannelTable::kNChannels; ch++) {
+      TChSettings chSettings;
+      chSettings.mod = mod;
+      chSettings.ch = ch;
+      chSettings.detectorID = mod * TChannelTable::kNChannels + ch;
+      chSettings.detectorType = TChSettings::GetDefaultDetectorType(mod);
+      chSettings.isEventTrigger = (mod == 2 && ch == 0);
+      settings[mod].push_back(chSettings);
+    }
+  }
+  return settings;
+}
+
+// A trigger every ~1.3 us on average: +-1 us windows overlap often
+THitBuffer GenerateHits(size_t nHits)
+{
+  std::mt19937_64 rng(1);
+  std::exponential_distribution<double_t> gap(1. / 20000.);  // ps
+  THitBuffer hits;
+  Timestamp_t time = 0;
+  for (size_t i = 0; i < nHits; i++) {
+    time += std::llround(gap(rng));
+    const uint16_t adc = rng() % 4000;
+    HitData_t hit(rng() % kNModules, rng() % TChannelTable::kNChannels, 0.,
+                  adc, adc / 2);
+    hits.PushBack(hit, time);
+  }
+  return hits;
+}
+
+bool IsSame(const TEventBatch &a, const TEventBatch &b)
+{
+  if (a.Size() != b.Size() || a.HitOffset != b.HitOffset) return false;
+  for (size_t i = 0; i < a.Size(); i++) {
+    const auto &x = a.Event[i];
+    const auto &y = b.Event[i];
+    if (x.IsFissionEvent != y.IsFissionEvent || x.TriggerID != y.TriggerID ||
+        x.SiFrontMultiplicity != y.SiFrontMultiplicity ||
+        x.SiBackMultiplicity != y.SiBackMultiplicity ||
+        x.SiMultiplicity != y.SiMultiplicity ||
+        x.GammaMultiplicity != y.GammaMultiplicity ||
+        x.NeutronMultiplicity != y.NeutronMultiplicity ||
+        x.TriggerTime != y.TriggerTime) {
+      return false;
+    }
+  }
+  return a.Hit.Timestamp == b.Hit.Timestamp && a.Hit.Module == b.Hit.Module &&
+         a.Hit.Channel == b.Hit.Channel && a.Hit.Energy == b.Hit.Energy &&
+         a.Hit.EnergyShort == b.Hit.EnergyShort;
+}
+
+// Number of slice boundaries of ParallelBuildEvents() inside an event, for
+// the hits given sorted
+uint32_t CountCrossedSlices(const THitBuffer &hits, const TEventBatch &events)
+{
+  uint32_t nCrossed = 0;
+  for (uint32_t i = 1; i < kNSlices; i++) {
+    const auto boundary = hits.Timestamp[hits.Size() * i / kNSlices];
+    for (size_t j = 0; j < events.Size(); j++) {
+      const auto trigger = events.Event[j].TriggerTime;
+      const auto begin = events.HitOffset[j];
+      const auto end = events.HitOffset[j + 1];
+      if (begin == end) continue;
+      const auto [first, last] = std::minmax_element(
+          events.Hit.Timestamp.begin() + begin,
+          events.Hit.Timestamp.begin() + end);
+      if (trigger + *first < boundary && trigger + *last >= boundary) {
+        nCrossed++;
+        break;
+      }
+    }
+  }
+  return nCrossed;
+}
+}  // namespace
+
+int main()
+{
+  const auto settings = GetSettings();
+  const auto hits = GenerateHits(200000);
+  constexpr size_t kChunkSize = 1000;
+
+  const std::vector<std::pair<OverlapPolicy_t, std::string>> policies = {
+      {OverlapPolicy::DeadTime, "DeadTime"},
+      {OverlapPolicy::AllowOverlap, "AllowOverlap"},
+      {OverlapPolicy::Merge, "Merge"}};
+  auto nFailed = 0;
+  for (const auto &[policy, name] : policies) {
+    TEventBuilder serial("synthetic", kTimeWindow, false, settings);
+    serial.SetOverlapPolicy(policy);
+    serial.SetHitData(hits);
+    serial.EventBuild();
+    auto expected = serial.GetEventData();
+
+    TEventBuilder streaming("synthetic", kTimeWindow, false, settings);
+    streaming.SetOverlapPolicy(policy);
+    streaming.SetMaxTimeDisorder(1.);
+    size_t position = 0;
+    auto source = [&](THitBuffer &chunk) {
+      if (position == hits.Size()) return false;
+      chunk.Clear();
+      const auto end = std::min(position + kChunkSize, hits.Size());
+      for (; position < end; position++) chunk.PushBack(hits, position);
+      return true;
+    };
+    TEventBatch events;
+    streaming.StreamBuild(source, [&](std::unique_ptr<TEventBatch> &batch) {
+      events.Append(*batch);
+    });
+
+    const auto isSame = IsSame(*expected, events);
+    std::cout << name << ": " << expected->Size() << " events, stream "
+              << events.Size() << (isSame ? " OK" : " MISMATCH") << std::endl;
+    if (!isSame) nFailed++;
+  }
+
+  // One channel out of order: sorted, and counted, by both builders
+  auto parallelHits = GenerateHits(kNParallelHits);
+  for (size_t j = 1; j < parallelHits.Size(); j++) {
+    if (parallelHits.Module[j] == parallelHits.Module[0] &&
+        parallelHits.Channel[j] == parallelHits.Channel[0]) {
+      std::swap(parallelHits.Timestamp[0], parallelHits.Timestamp[j]);
+      break;
+    }
+  }
+  for (const auto &[policy, name] : policies) {
+    TEventBuilder serial("synthetic", kTimeWindow, false, settings);
+    serial.SetOverlapPolicy(policy);
+    serial.SetHitData(parallelHits);
+    serial.EventBuild();
+    auto expected = serial.GetEventData();
+
+    TEventBuilder parallel("synthetic", kTimeWindow, false, settings);
+    parallel.SetOverlapPolicy(policy);
+    parallel.SetNThreads(4);
+    parallel.SetHitData(parallelHits);
+    parallel.EventBuild();
+    auto events = parallel.GetEventData();
+
+    auto isSame = IsSame(*expected, *events) &&
+                  parallel.GetNUnorderedStreams() == 1 &&
+                  serial.GetNUnorderedStreams() == 1;
+    const auto nCrossed = CountCrossedSlices(parallelHits, *expected);
+    std::cout << name << ": " << expected->Size() << " events, 4 threads "
+              << events->Size() << ", " << nCrossed << " of " << kNSlices - 1
+              << " slice ends inside an event" << (isSame ? " OK" : " MISMATCH")
+              << std::endl;
+    // The merged events must cross the slice ends to test the join
+    if (policy == OverlapPolicy::Merge && nCrossed == 0) isSame = false;
+    if (!isSame) nFailed++;
+  }
+
+  return (nFailed > 0) ? 1 : 0;
+}